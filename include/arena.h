@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C"
+{
+#include <tamalib.h>
+}
+
+/*
+    Fixed-size arena for every emulator and HAL allocation (tamalib's
+    hal_t.malloc, the ROM image, save state buffers, the capture ring).
+    It is a static array, so long uptimes never fragment the system heap
+    the display and audio buffers come from.
+
+    Blocks are first-fit with an 8-byte header; neighbouring free blocks
+    are merged as the allocator walks past them. Running out in
+    arena_malloc(), which backs tamalib's allocations, is fatal: the arena
+    is sized for the known allocations, so it means a leak. Buffers the
+    firmware can do without (ROM and state file reads, the capture ring)
+    use arena_try_malloc() and handle NULL.
+*/
+
+// ROM (12 KB) + capture ring (4 KB) + a legacy state file (4 KB) + slack
+#ifndef ARENA_SIZE
+#define ARENA_SIZE (24 * 1024)
+#endif
+
+typedef struct
+{
+    size_t used;
+    size_t peak;
+    size_t largest_free;
+    uint32_t allocations;
+    uint32_t live;
+} arena_stats_t;
+
+void *arena_malloc(u32_t size); // hal_t.malloc signature
+void *arena_try_malloc(size_t size);
+void arena_free(void *ptr);
+void arena_get_stats(arena_stats_t *stats);
+void arena_report();
+
+#endif // ARENA_H
@@ -0,0 +1,39 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include "tamalib_cardputer_hal.h"
+
+// Shortest time the splash screen stays up, even if loading finishes first
+#define BOOT_SPLASH_MIN_MS 1000
+
+// Boot phases, in the order they are reached
+typedef enum
+{
+    BOOT_START = 0,
+    BOOT_DISPLAY_READY,
+    BOOT_SPLASH_SHOWN,
+    BOOT_SD_MOUNTED,
+    BOOT_ROM_DECODED,
+    BOOT_STATE_READ,
+    BOOT_SPLASH_DONE,
+    BOOT_EMU_READY,
+    BOOT_FIRST_FRAME,
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+// Results handed over by the background loader
+typedef struct
+{
+    u12_t *rom_data;
+    bool state_found;
+    state_file_t state;
+} boot_result_t;
+
+void boot_mark(boot_phase_t phase);
+void boot_start_loader();
+bool boot_loader_done();
+bool boot_select_rom();
+boot_result_t *boot_result();
+void boot_first_frame();
+
+#endif // BOOT_H
@@ -0,0 +1,36 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "tamalib_cardputer_hal.h"
+#include "capture_packet.h"
+
+/*
+    Frame capture. Each packet holds one frame (LCD matrix + icon bits)
+    XORed against the previous frame and run-length encoded:
+
+      'T' 'F' flags seq[2] time_ms[4] len payload[len] checksum
+
+    flags bit 0 marks a keyframe (XOR against an all-clear frame). The
+    checksum is the 8-bit sum of every byte from flags to the end of the
+    payload. SD recordings start with a "TCAP" file header.
+*/
+
+#define CAPTURE_KEYFRAME_INTERVAL 50
+
+#define CAPTURE_RING_SIZE 4096
+#define CAPTURE_FILE "/tamaputer/capture.tcap"
+
+typedef enum
+{
+    CAPTURE_OFF = 0,
+    CAPTURE_SERIAL,
+    CAPTURE_SD,
+} capture_target_t;
+
+bool capture_start(capture_target_t target);
+void capture_stop();
+capture_target_t capture_target();
+void capture_frame(const uint8_t *matrix, const bool_t *icons);
+void capture_report();
+
+#endif // CAPTURE_H
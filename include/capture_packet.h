@@ -0,0 +1,25 @@
+#ifndef CAPTURE_PACKET_H
+#define CAPTURE_PACKET_H
+
+#include <stdint.h>
+
+/*
+    Frame capture packet encoder, see capture.h for the packet layout.
+    Kept free of Arduino dependencies so it also builds on the host.
+
+    Two equal bytes are folded into a literal run instead of ending it, so
+    the PackBits payload is never larger than the frame plus one header
+    byte per 128 bytes, which is what CAPTURE_PACKET_MAX is sized for.
+*/
+
+#define CAPTURE_MATRIX_SIZE (32 * 16 / 8)                // 32x16 LCD, 1bpp
+#define CAPTURE_FRAME_SIZE (CAPTURE_MATRIX_SIZE + 1)     // Matrix + one byte of icon bits
+#define CAPTURE_PAYLOAD_MAX (CAPTURE_FRAME_SIZE + (CAPTURE_FRAME_SIZE + 127) / 128)
+#define CAPTURE_PACKET_MAX (10 + CAPTURE_PAYLOAD_MAX + 1)
+#define CAPTURE_FLAG_KEYFRAME 0x01
+
+uint8_t capture_rle_encode(const uint8_t *src, uint8_t len, uint8_t *dst);
+uint8_t capture_packet(uint8_t *packet, uint8_t flags, uint16_t seq, uint32_t time_ms,
+                       const uint8_t *delta);
+
+#endif // CAPTURE_PACKET_H
@@ -0,0 +1,26 @@
+#ifndef HAL_DISPATCH_H
+#define HAL_DISPATCH_H
+
+#include "tamalib_cardputer_hal.h"
+
+/*
+    HAL calls made by the firmware itself. The perf build calls the
+    Cardputer HAL functions directly so they can be inlined; the default
+    build goes through g_hal like tamalib does. Calls inside tamalib always
+    use g_hal, it is a submodule.
+
+    TAMA_HOT marks HAL callbacks that run on every emulated instruction,
+    which the perf build places in IRAM.
+*/
+
+#ifdef TAMA_PERF_BUILD
+#define TAMA_HOT IRAM_ATTR
+#define TAMA_BUILD_NAME "perf"
+#define HAL_CALL(fn) hal_##fn
+#else
+#define TAMA_HOT
+#define TAMA_BUILD_NAME "default"
+#define HAL_CALL(fn) g_hal->fn
+#endif
+
+#endif // HAL_DISPATCH_H
@@ -0,0 +1,36 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "tamalib_cardputer_hal.h"
+
+/*
+    Input-to-pixel latency tracing. A game button edge seen by
+    handle_input() is followed through tamalib_set_button(), the first LCD
+    pixel or icon it changes and the display push that shows it:
+
+      scan   edge seen -> buttons handed to tamalib
+      emu    tamalib_set_button() -> first LCD change
+      draw   first LCD change -> update_display() done
+      total  edge seen -> update_display() done
+
+    Time spent before the keyboard scan notices the key is not visible
+    here; it is at most INPUT_POLL_US. One event is traced at a time, and
+    edges with no LCD change within LATENCY_TIMEOUT_US are counted as
+    timeouts (many presses legitimately change nothing).
+*/
+
+#define LATENCY_SAMPLES 128
+#define LATENCY_TIMEOUT_US 1000000
+
+// Print every traced event over serial, not just the summaries (debug)
+#ifndef LATENCY_LOG_EVENTS
+#define LATENCY_LOG_EVENTS 0
+#endif
+
+void latency_key_edge();
+void latency_button_set();
+void latency_lcd_change();
+void latency_display_pushed();
+void latency_report();
+
+#endif // LATENCY_H
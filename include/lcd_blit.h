@@ -0,0 +1,59 @@
+#ifndef LCD_BLIT_H
+#define LCD_BLIT_H
+
+#include <stdint.h>
+
+/*
+    1bpp to RGB565 scaling blitter. Source rows are packed MSB first
+    (width / 8 bytes per row), output rows are width * scale pixels and
+    must be 4-byte aligned. Kept free of Arduino dependencies so it also
+    builds on the host.
+*/
+
+#define LCD_BLIT_MAX_WIDTH 32 // Source pixels per row, multiple of 8
+#define LCD_BLIT_MAX_SCALE 8
+
+#define LCD_BLIT_MAX_OUT (LCD_BLIT_MAX_WIDTH * LCD_BLIT_MAX_SCALE)
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+#define LCD_BLIT_HAVE_SIMD 1
+#else
+#define LCD_BLIT_HAVE_SIMD 0
+#endif
+
+typedef struct
+{
+    uint8_t width;
+    uint8_t scale;
+    uint16_t fg;
+    uint16_t bg;
+
+    // Each source nibble expanded to 4 * scale output pixels
+    alignas(4) uint16_t nibble[16][4 * LCD_BLIT_MAX_SCALE];
+
+#if LCD_BLIT_HAVE_SIMD
+    // For every 8 output pixels: the source byte the window starts at and
+    // the bit each lane tests in the 16-bit window
+    uint8_t block_byte[LCD_BLIT_MAX_OUT / 8];
+    uint16_t block_mask[LCD_BLIT_MAX_OUT / 8][8];
+#endif
+} lcd_blit_t;
+
+// Returns false if width or scale is out of range
+bool lcd_blit_init(lcd_blit_t *blit, uint8_t width, uint8_t scale, uint16_t fg, uint16_t bg);
+
+// Expand one source row into width * scale pixels
+void lcd_blit_row_scalar(const lcd_blit_t *blit, const uint8_t *src, uint16_t *dst);
+void lcd_blit_row_lut(const lcd_blit_t *blit, const uint8_t *src, uint16_t *dst);
+#if LCD_BLIT_HAVE_SIMD
+void lcd_blit_row_simd(const lcd_blit_t *blit, const uint8_t *src, uint16_t *dst);
+#endif
+
+// Fastest row kernel available on this target
+void lcd_blit_row(const lcd_blit_t *blit, const uint8_t *src, uint16_t *dst);
+
+// Expand several source rows, each repeated scale times, into a
+// (width * scale) x (rows * scale) block
+void lcd_blit_rows(const lcd_blit_t *blit, const uint8_t *src, uint8_t rows, uint16_t *dst);
+
+#endif // LCD_BLIT_H
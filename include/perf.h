@@ -0,0 +1,18 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+/*
+    Emulator throughput, counted on the loop task. Emulation is paced to
+    real time, so the step rate alone barely changes between builds; the
+    time not spent waiting in hal_sleep_until() shows how many steps per
+    second the build could run.
+*/
+
+extern uint32_t perf_steps;
+extern uint32_t perf_wait_us;
+
+void perf_report();
+
+#endif // PERF_H
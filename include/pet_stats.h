@@ -0,0 +1,31 @@
+#ifndef PET_STATS_H
+#define PET_STATS_H
+
+#include "tamalib_cardputer_hal.h"
+
+/*
+    Pet statistics HUD and analytics log, driven by RAM watchpoints.
+
+    Which nibbles hold what depends on the ROM, so addresses come from a
+    per-ROM map on the SD card, /tamaputer/maps/<rom crc32 in hex>.map,
+    one "name address [nibbles]" entry per line, address in hex and
+    nibbles 1-4 (default 1). Lines starting with '#' are comments.
+
+    Every change is drawn to the right of the LCD and appended to
+    /tamaputer/stats.csv as "uptime_s,time,name,value". Log lines are
+    buffered and written out when the buffer fills or pet_stats_flush()
+    is called.
+*/
+
+#define PET_STATS_MAP_DIR "/tamaputer/maps"
+#define PET_STATS_LOG_FILE "/tamaputer/stats.csv"
+#define PET_STATS_MAX 6
+#define PET_STATS_NAME_SIZE 12
+#define PET_STATS_LOG_BUFFER 1024
+
+void pet_stats_init();
+void pet_stats_invalidate();
+void pet_stats_draw();
+void pet_stats_flush();
+
+#endif // PET_STATS_H
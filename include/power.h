@@ -0,0 +1,33 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include "tamalib_cardputer_hal.h"
+
+/*
+    Idle power governor. A keypress or a buzzer event keeps the device at
+    full power; after a while without either, the redraw rate, backlight
+    and CPU clock step down. Emulation speed does not change with the
+    clock, tamalib paces itself against hal_get_timestamp().
+*/
+
+typedef enum
+{
+    POWER_FULL = 0,
+    POWER_DIM,
+    POWER_SLEEP,
+    POWER_LEVEL_COUNT
+} power_level_t;
+
+// Time without input or buzzer before stepping down
+#define POWER_DIM_AFTER_MS 30000
+#define POWER_SLEEP_AFTER_MS 180000
+
+void power_init();
+void power_activity();
+void power_update();
+void power_frame(bool changed);
+power_level_t power_level();
+uint8_t power_frame_rate();
+void power_report();
+
+#endif // POWER_H
@@ -0,0 +1,56 @@
+#ifndef ROM_LIBRARY_H
+#define ROM_LIBRARY_H
+
+#include "tamalib_cardputer_hal.h"
+
+/*
+    ROM library. Every file in /tamaputer/roms/ (plus the legacy
+    /tamaputer/tama.b) is listed once in an index file with its path, size,
+    CRC32 and status, so boot and the selector never open the ROMs
+    themselves. The index is rebuilt when it is missing, from the selector
+    (R), or when a listed ROM fails to load.
+*/
+
+#define ROM_LIBRARY_DIR "/tamaputer/roms"
+#define ROM_LIBRARY_INDEX "/tamaputer/roms.idx"
+#define ROM_LEGACY_FILE "/tamaputer/tama.b"
+#define ROM_LIBRARY_MAX 32
+#define ROM_PATH_SIZE 64
+
+#define ROM_INDEX_MAGIC 0x58495254 // "TRIX"
+#define ROM_INDEX_VERSION 1
+
+typedef enum
+{
+    ROM_READY = 0,
+    ROM_BAD_SIZE,   // Not a ROM_SIZE image, can't be run
+    ROM_UNREADABLE, // Read error while hashing
+} rom_status_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t count;
+    uint8_t reserved[2];
+    uint32_t last_crc; // ROM started most recently
+} rom_index_header_t;
+
+typedef struct
+{
+    char path[ROM_PATH_SIZE];
+    uint32_t size;
+    uint32_t crc;
+    uint8_t status;
+    uint8_t reserved[3];
+} rom_entry_t;
+
+bool rom_library_load();
+bool rom_library_scan();
+uint8_t rom_library_ready_count();
+const rom_entry_t *rom_library_entry(int index);
+int rom_library_default();
+void rom_library_set_last(uint32_t crc);
+int rom_library_select(int preselected);
+
+#endif // ROM_LIBRARY_H
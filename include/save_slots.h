@@ -0,0 +1,48 @@
+#ifndef SAVE_SLOTS_H
+#define SAVE_SLOTS_H
+
+#include <Arduino.h>
+#include "tamalib_cardputer_hal.h"
+
+// Number of save slots available on the SD card
+#define SAVE_SLOT_COUNT 4
+
+// 32x16 1bpp LCD thumbnail, rows packed MSB first
+#define SLOT_THUMB_SIZE (LCD_WIDTH * LCD_HEIGHT / 8)
+
+#define SLOT_INDEX_MAGIC 0x58495354 // "TSIX"
+#define SLOT_INDEX_VERSION 1
+
+// Index header, stored once at the start of the index file
+typedef struct
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t slot_count;
+    uint8_t active_slot; // Slot saved/loaded most recently
+    uint8_t reserved;
+} slot_index_header_t;
+
+// One fixed-size record per slot, so a slot can be rewritten in place
+typedef struct
+{
+    uint8_t used;
+    uint8_t reserved[3];
+    uint32_t timestamp; // time() at save, seconds since boot if no RTC
+    uint32_t rom_hash;  // CRC32 of the ROM the state belongs to
+    uint32_t play_time; // Accumulated play time in seconds
+    uint8_t thumb[SLOT_THUMB_SIZE];
+} slot_info_t;
+
+extern uint8_t active_slot;
+
+String slot_state_path(uint8_t slot);
+bool slot_dir_create();
+bool slot_index_read(slot_info_t *slots, uint8_t *last_slot = NULL);
+bool slot_index_update(uint8_t slot, const slot_info_t *info);
+void slot_migrate_legacy();
+void slot_play_time_reset(uint32_t base);
+uint32_t slot_play_time();
+void slot_picker();
+
+#endif // SAVE_SLOTS_H
@@ -0,0 +1,64 @@
+#ifndef STATE_CODEC_H
+#define STATE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C"
+{
+#include <tamalib.h>
+}
+
+/*
+    Compact save state encoding.
+
+      "TSZ2"                      magic
+      registers                   bit-packed, timer timestamps as varint
+                                  distances from tick_counter
+      memory                      RAM nibbles packed two per byte (even
+                                  address in the low nibble), then LZ
+                                  compressed
+      crc32                       u32 LE, CRC-32 (zlib) of everything
+                                  before it
+
+    "TSZ1" streams are the same without the CRC. They still decode, but
+    only their structure can be checked.
+
+    LZ tokens: 0x00-0x7F = 1-128 literal bytes follow,
+               0x80-0xFF = copy (c & 0x7F) + 3 bytes from offset (u16 LE)
+                           bytes back in the output
+
+    Decoding writes straight into state->memory and resolves matches
+    from it, so loading needs no buffer the size of the memory.
+    No Arduino dependencies, so host tools can use it too.
+*/
+
+#define STATE_CODEC_MAGIC "TSZ2"
+#define STATE_CODEC_MAGIC_V1 "TSZ1" // No CRC trailer
+#define STATE_CODEC_MAGIC_SIZE 4
+
+#ifdef LOW_FOOTPRINT
+#define STATE_PACKED_SIZE MEM_BUFFER_SIZE
+#else
+#define STATE_PACKED_SIZE (MEM_BUFFER_SIZE / 2)
+#endif
+
+// Output sink / input source; return the number of bytes written / read
+typedef size_t (*state_write_t)(void *ctx, const uint8_t *data, size_t len);
+typedef size_t (*state_read_t)(void *ctx, uint8_t *data, size_t len);
+
+// Returns the encoded size, or 0 if the sink failed
+size_t state_encode(state_t *state, state_write_t write, void *ctx);
+
+// Returns false on a truncated or malformed stream or a CRC mismatch.
+// Registers are only written on success, but memory may already be partly
+// overwritten, so run state_check() first when the source can be read
+// twice. Call tamalib_refresh_hw() after a successful decode.
+bool state_decode(state_t *state, state_read_t read, void *ctx);
+
+// Walks the stream and verifies its CRC without touching any state
+bool state_check(state_read_t read, void *ctx);
+
+bool state_is_encoded(const uint8_t *data, size_t len);
+
+#endif // STATE_CODEC_H
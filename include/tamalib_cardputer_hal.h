@@ -15,6 +15,13 @@ extern "C"
 #define M5_BTN_SAVE 'z'
 #define M5_BTN_PAUSE 'p'
 #define M5_BTN_HELP '`'
+#define M5_BTN_SLOTS 's'
+#define M5_BTN_CAPTURE 'c'
+#define M5_BTN_RECORD 'v'
+#define M5_BTN_ROMS 'r'
+
+// Size of a Tamagotchi P1 ROM image (12KB)
+#define ROM_SIZE 12288
 
 // Tamagotchi LCD dimensions
 #define LCD_WIDTH 32
@@ -42,12 +49,33 @@ extern "C"
     void hal_log(log_level_t level, char *buff, ...);
 }
 
+// Save state file read ahead of tamalib_init()
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    uint8_t slot;
+    uint32_t play_time;
+} state_file_t;
+
+// CRC32 of the loaded ROM image, used to tie save states to a ROM
+extern uint32_t rom_crc;
+
 // Helper functions
+bool sd_mount();
+void sd_unmount();
+void lcd_thumbnail(uint8_t *thumb);
+void display_invalidate();
 void update_display();
 void display_help();
 void handle_input();
 void save_state();
 u12_t *load_rom();
+void rom_error();
+bool read_state_file(uint8_t slot, state_file_t *file);
+void free_state_file(state_file_t *file);
+bool_t apply_state_file(const state_file_t *file);
 bool_t load_from_state();
+bool_t load_state_slot(uint8_t slot);
 
 #endif // TAMALIB_HAL_H
@@ -0,0 +1,47 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdint.h>
+
+extern "C"
+{
+#include <tamalib.h>
+}
+
+/*
+    RAM watchpoints. A watch covers 1-4 consecutive nibbles (lowest address
+    in the lowest nibble of the value) and calls back when their value
+    changes.
+
+    tamalib has no hook on memory writes, so these are not write callbacks:
+    watch_poll() runs once per frame, before the screen update that draws
+    the HUD, and compares the watched nibbles against their last value.
+    Writes of an unchanged value, and values that change back within a
+    frame, are not reported. With no watch registered it is a single
+    inline test.
+*/
+
+#define WATCH_MAX 16
+#define WATCH_NONE -1
+
+typedef void (*watch_cb_t)(int id, uint16_t value, uint16_t old, void *ctx);
+
+// Returns the watch id, or WATCH_NONE if the table is full or the range
+// is out of memory. The current value becomes the baseline.
+int watch_add(u12_t addr, uint8_t nibbles, watch_cb_t cb, void *ctx);
+void watch_remove(int id);
+void watch_clear();
+uint16_t watch_value(int id);
+
+extern uint8_t watch_count;
+void watch_poll_all();
+
+static inline void watch_poll()
+{
+    if (watch_count)
+    {
+        watch_poll_all();
+    }
+}
+
+#endif // WATCH_H
@@ -0,0 +1,49 @@
+# Extra script for the m5stack-stamps3-perf environment.
+#
+# tamalib is a submodule, so its interpreter can't be tagged IRAM_ATTR.
+# Instead its hot objects are built without LTO and every code section is
+# renamed into .iram1.*, which the ESP32-S3 linker script places in IRAM.
+
+import subprocess
+
+Import("env")
+
+IRAM_SOURCES = ("cpu.c", "hw.c")
+
+# LTO objects have to be linked with LTO too
+env.Append(LINKFLAGS=["-flto", "-O2"])
+
+
+def code_sections(objdump, path):
+    out = subprocess.run([objdump, "-h", path], capture_output=True, text=True, check=True).stdout
+    sections = []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) > 1 and fields[0].isdigit():
+            name = fields[1]
+            if name in (".text", ".literal") or name.startswith((".text.", ".literal.")):
+                sections.append(name)
+    return sections
+
+
+def move_to_iram(target, source, env):
+    objcopy = env.subst("$OBJCOPY")
+    objdump = objcopy.replace("objcopy", "objdump")
+    for node in target:
+        path = node.get_abspath()
+        args = [objcopy]
+        for name in code_sections(objdump, path):
+            args += ["--rename-section", "%s=.iram1%s" % (name, name)]
+        subprocess.run(args + [path], check=True)
+
+
+def iram_object(env, node):
+    if node.name not in IRAM_SOURCES:
+        return node
+    flags = [f for f in env["CCFLAGS"] if f != "-flto"] + ["-ffunction-sections"]
+    obj = env.Object(node, CCFLAGS=flags)
+    env.AddPostAction(obj, env.VerboseAction(move_to_iram, "Moving $TARGET to IRAM"))
+    return obj
+
+
+env.AddBuildMiddleware(iram_object, "*tamalib*")
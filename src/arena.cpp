@@ -0,0 +1,173 @@
+/*
+    Static arena allocator, see arena.h. Allocations are few and mostly
+    live for the whole run, so a plain walk over the blocks is enough.
+*/
+
+#include "arena.h"
+#include <M5Cardputer.h>
+
+#define ARENA_ALIGN 8
+
+typedef struct
+{
+    uint32_t size; // Including this header
+    uint32_t used;
+} block_t;
+
+#define BLOCK_HEADER sizeof(block_t)
+#define BLOCK_MIN (BLOCK_HEADER + ARENA_ALIGN)
+
+alignas(ARENA_ALIGN) static uint8_t arena[ARENA_SIZE];
+static bool arena_ready = false;
+static portMUX_TYPE arena_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static size_t used = 0;
+static size_t peak = 0;
+static uint32_t allocations = 0;
+static uint32_t live = 0;
+
+static inline block_t *block_at(size_t offset)
+{
+    return (block_t *)(arena + offset);
+}
+
+static void arena_init()
+{
+    block_t *first = block_at(0);
+    first->size = ARENA_SIZE;
+    first->used = 0;
+    arena_ready = true;
+}
+
+// Out of arena: report where the memory went and stop
+static void arena_fail(size_t size)
+{
+    USBSerial.printf("[!] Arena exhausted allocating %u bytes\n", (unsigned)size);
+    arena_report();
+
+    M5Cardputer.Display.fillScreen(TFT_RED);
+    M5Cardputer.Display.setTextSize(2);
+    M5Cardputer.Display.setTextColor(TFT_WHITE);
+    M5Cardputer.Display.setCursor(10, 50);
+    M5Cardputer.Display.println("OUT OF MEMORY");
+    M5Cardputer.Display.setCursor(10, 70);
+    M5Cardputer.Display.printf("%u byte request\n", (unsigned)size);
+    while (1)
+        delay(1000);
+}
+
+// Returns NULL when the arena is exhausted
+void *arena_try_malloc(size_t size)
+{
+    size_t need = (size + BLOCK_HEADER + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    void *ptr = NULL;
+
+    portENTER_CRITICAL(&arena_lock);
+    if (!arena_ready)
+    {
+        arena_init();
+    }
+
+    for (size_t offset = 0; offset < ARENA_SIZE; offset += block_at(offset)->size)
+    {
+        block_t *block = block_at(offset);
+        if (block->used)
+        {
+            continue;
+        }
+
+        // Merge the free blocks that follow into this one
+        while (offset + block->size < ARENA_SIZE && !block_at(offset + block->size)->used)
+        {
+            block->size += block_at(offset + block->size)->size;
+        }
+        if (block->size < need)
+        {
+            continue;
+        }
+
+        // Split off the rest if it can hold another allocation
+        if (block->size - need >= BLOCK_MIN)
+        {
+            block_t *rest = block_at(offset + need);
+            rest->size = block->size - need;
+            rest->used = 0;
+            block->size = need;
+        }
+        block->used = 1;
+
+        used += block->size;
+        peak = used > peak ? used : peak;
+        allocations++;
+        live++;
+        ptr = (uint8_t *)block + BLOCK_HEADER;
+        break;
+    }
+    portEXIT_CRITICAL(&arena_lock);
+    return ptr;
+}
+
+// tamalib has no way to handle a failed allocation, so running out stops
+void *arena_malloc(u32_t size)
+{
+    void *ptr = arena_try_malloc(size);
+    if (!ptr && size)
+    {
+        arena_fail(size);
+    }
+    return ptr;
+}
+
+void arena_free(void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    block_t *block = (block_t *)((uint8_t *)ptr - BLOCK_HEADER);
+    portENTER_CRITICAL(&arena_lock);
+    block->used = 0;
+    used -= block->size;
+    live--;
+    portEXIT_CRITICAL(&arena_lock);
+}
+
+void arena_get_stats(arena_stats_t *stats)
+{
+    portENTER_CRITICAL(&arena_lock);
+    if (!arena_ready)
+    {
+        arena_init();
+    }
+
+    stats->used = used;
+    stats->peak = peak;
+    stats->allocations = allocations;
+    stats->live = live;
+    stats->largest_free = 0;
+
+    // Runs of free blocks count as one, they are merged on the next fit
+    size_t run = 0;
+    for (size_t offset = 0; offset < ARENA_SIZE; offset += block_at(offset)->size)
+    {
+        run = block_at(offset)->used ? 0 : run + block_at(offset)->size;
+        if (run > stats->largest_free)
+        {
+            stats->largest_free = run;
+        }
+    }
+    stats->largest_free = stats->largest_free > BLOCK_HEADER ? stats->largest_free - BLOCK_HEADER : 0;
+    portEXIT_CRITICAL(&arena_lock);
+}
+
+void arena_report()
+{
+    arena_stats_t stats;
+    arena_get_stats(&stats);
+    USBSerial.printf("[*] Arena: %u / %u bytes used, peak %u, largest free %u\n",
+                     (unsigned)stats.used, (unsigned)ARENA_SIZE, (unsigned)stats.peak,
+                     (unsigned)stats.largest_free);
+    USBSerial.printf("[*] Arena: %lu allocations, %lu live\n",
+                     (unsigned long)stats.allocations, (unsigned long)stats.live);
+}
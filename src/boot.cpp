@@ -0,0 +1,158 @@
+/*
+    Boot pipeline. SD mount, ROM decode and the save state read run in a
+    background task while the splash screen is up, and each boot phase is
+    timestamped so the time to first frame can be reported over serial.
+    Only the ROM library index is read to pick the ROM, the ROM files
+    themselves are opened once it is chosen.
+*/
+
+#include "boot.h"
+#include "arena.h"
+#include "rom_library.h"
+#include "save_slots.h"
+#include <SD.h>
+
+// External variables from main.cpp
+extern String ROM_FILE;
+
+static const char *boot_phase_names[BOOT_PHASE_COUNT] = {
+    "start",
+    "display ready",
+    "splash shown",
+    "sd mounted",
+    "rom decoded",
+    "state read",
+    "splash done",
+    "emulator ready",
+    "first frame",
+};
+
+static uint32_t boot_times[BOOT_PHASE_COUNT] = {0};
+static boot_result_t result = {NULL, false, {NULL, 0, 0, 0}};
+static volatile bool loader_done = false;
+
+void boot_mark(boot_phase_t phase)
+{
+    boot_times[phase] = micros();
+}
+
+// Load a library ROM and pre-read its most recently used slot (SD must be
+// mounted)
+static void boot_load_rom(int rom)
+{
+    const rom_entry_t *entry = rom_library_entry(rom);
+    ROM_FILE = entry->path;
+    result.rom_data = load_rom();
+    boot_mark(BOOT_ROM_DECODED);
+
+    // The ROM went missing or changed since it was indexed
+    if (!result.rom_data || rom_crc != entry->crc)
+    {
+        USBSerial.println("[!] ROM library index is stale, rescanning");
+        rom_library_scan();
+    }
+    if (!result.rom_data)
+    {
+        return;
+    }
+
+    rom_library_set_last(rom_crc);
+    slot_migrate_legacy();
+
+    uint8_t last_slot = 0;
+    slot_info_t slots[SAVE_SLOT_COUNT];
+    slot_index_read(slots, &last_slot);
+    result.state_found = read_state_file(last_slot, &result.state);
+    boot_mark(BOOT_STATE_READ);
+}
+
+static void boot_loader_task(void *arg)
+{
+    if (sd_mount())
+    {
+        boot_mark(BOOT_SD_MOUNTED);
+
+        // Start the last used ROM, or the only one, without asking
+        rom_library_load();
+        int rom = rom_library_default();
+        if (rom >= 0)
+        {
+            boot_load_rom(rom);
+        }
+        sd_unmount();
+    }
+
+    loader_done = true;
+    vTaskDelete(NULL);
+}
+
+// Start loading on core 0 while the loop task keeps the splash on core 1
+void boot_start_loader()
+{
+    loader_done = false;
+    xTaskCreatePinnedToCore(boot_loader_task, "boot_loader", 8192, NULL, 1, NULL, 0);
+}
+
+bool boot_loader_done()
+{
+    return loader_done;
+}
+
+// Let the player pick a ROM once the loader is done, replacing whatever
+// the loader started. Returns false if the selector was left without one.
+bool boot_select_rom()
+{
+    int rom = rom_library_select(result.rom_data ? rom_library_default() : -1);
+    if (rom < 0)
+    {
+        return false;
+    }
+    if (result.rom_data && rom_library_entry(rom)->crc == rom_crc)
+    {
+        return true;
+    }
+
+    arena_free(result.rom_data);
+    result.rom_data = NULL;
+    free_state_file(&result.state);
+    result.state_found = false;
+
+    if (sd_mount())
+    {
+        boot_load_rom(rom);
+        sd_unmount();
+    }
+    return true;
+}
+
+boot_result_t *boot_result()
+{
+    return &result;
+}
+
+// Called on the first screen update, prints the boot timing report
+void boot_first_frame()
+{
+    if (boot_times[BOOT_FIRST_FRAME])
+    {
+        return;
+    }
+    boot_mark(BOOT_FIRST_FRAME);
+
+    USBSerial.println("[*] Boot timing (ms since power on, +ms since previous phase):");
+    uint32_t prev = boot_times[BOOT_START];
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+    {
+        // Phases that were skipped (e.g. no SD card) are never marked
+        if (!boot_times[i])
+        {
+            continue;
+        }
+        USBSerial.printf("    %-15s %8.1f  +%.1f\n",
+                         boot_phase_names[i],
+                         boot_times[i] / 1000.0f,
+                         (boot_times[i] - prev) / 1000.0f);
+        prev = boot_times[i];
+    }
+    USBSerial.printf("[*] Time to first frame: %.1f ms\n", boot_times[BOOT_FIRST_FRAME] / 1000.0f);
+}
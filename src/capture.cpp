@@ -0,0 +1,217 @@
+/*
+    Gameplay capture. Frames are encoded straight from the HAL's LCD and
+    icon buffers on the emulator thread (a fixed ~65 byte job), queued in a
+    ring buffer and written out by a background task, so a slow USB host or
+    SD card only ever costs dropped frames, never emulator time.
+*/
+
+#include "capture.h"
+#include "arena.h"
+#include <SD.h>
+#include <freertos/ringbuf.h>
+
+static capture_target_t target = CAPTURE_OFF;
+static RingbufHandle_t ring = NULL;
+static uint8_t *ring_storage = NULL;
+static StaticRingbuffer_t ring_struct;
+static TaskHandle_t writer_task = NULL;
+static volatile bool writer_stop = false;
+static volatile bool writer_done = false;
+static File capture_file;
+
+// Previous frame, the reference for the XOR delta
+static uint8_t prev_frame[CAPTURE_FRAME_SIZE];
+static uint16_t seq = 0;
+static bool force_keyframe = false;
+
+// Capture statistics
+static uint32_t frames = 0;
+static uint32_t dropped = 0;
+static uint32_t bytes_out = 0;
+static uint32_t encode_us_total = 0;
+static uint32_t encode_us_max = 0;
+
+static_assert(CAPTURE_MATRIX_SIZE == LCD_WIDTH * LCD_HEIGHT / 8, "capture frame size");
+
+static void capture_writer_task(void *arg)
+{
+    while (true)
+    {
+        size_t size = 0;
+        uint8_t *item = (uint8_t *)xRingbufferReceive(ring, &size, pdMS_TO_TICKS(50));
+        if (item)
+        {
+            if (target == CAPTURE_SD)
+            {
+                capture_file.write(item, size);
+            }
+            else
+            {
+                USBSerial.write(item, size);
+            }
+            vRingbufferReturnItem(ring, item);
+        }
+        else if (writer_stop)
+        {
+            break;
+        }
+    }
+
+    writer_done = true;
+    vTaskDelete(NULL);
+}
+
+bool capture_start(capture_target_t new_target)
+{
+    if (target != CAPTURE_OFF || new_target == CAPTURE_OFF)
+    {
+        return false;
+    }
+
+    if (new_target == CAPTURE_SD)
+    {
+        if (!sd_mount())
+        {
+            USBSerial.println("[!] SD init failed for capture");
+            return false;
+        }
+        capture_file = SD.open(CAPTURE_FILE, FILE_WRITE);
+        if (!capture_file)
+        {
+            USBSerial.println("[!] Capture file open failed!");
+            sd_unmount();
+            return false;
+        }
+        const uint8_t header[8] = {'T', 'C', 'A', 'P', 1, LCD_WIDTH, LCD_HEIGHT, ICON_COUNT};
+        capture_file.write(header, sizeof(header));
+    }
+
+    ring_storage = (uint8_t *)arena_try_malloc(CAPTURE_RING_SIZE);
+    if (!ring_storage)
+    {
+        USBSerial.println("[!] Not enough memory for capture");
+        if (new_target == CAPTURE_SD)
+        {
+            capture_file.close();
+            sd_unmount();
+        }
+        return false;
+    }
+    ring = xRingbufferCreateStatic(CAPTURE_RING_SIZE, RINGBUF_TYPE_NOSPLIT, ring_storage, &ring_struct);
+
+    frames = dropped = bytes_out = 0;
+    encode_us_total = encode_us_max = 0;
+    seq = 0;
+    force_keyframe = true;
+    writer_stop = false;
+    writer_done = false;
+    target = new_target;
+    xTaskCreatePinnedToCore(capture_writer_task, "capture", 4096, NULL, 1, &writer_task, 0);
+
+    USBSerial.printf("[*] Capture started (%s)\n", target == CAPTURE_SD ? CAPTURE_FILE : "serial");
+    return true;
+}
+
+void capture_stop()
+{
+    if (target == CAPTURE_OFF)
+    {
+        return;
+    }
+
+    // Let the writer drain what is queued, then tear down
+    writer_stop = true;
+    while (!writer_done)
+    {
+        delay(10);
+    }
+
+    if (target == CAPTURE_SD)
+    {
+        capture_file.close();
+        sd_unmount();
+    }
+    vRingbufferDelete(ring);
+    arena_free(ring_storage);
+    ring = NULL;
+    ring_storage = NULL;
+    writer_task = NULL;
+    target = CAPTURE_OFF;
+
+    capture_report();
+}
+
+capture_target_t capture_target()
+{
+    return target;
+}
+
+// Encode one frame from the HAL buffers and queue it without blocking
+void capture_frame(const uint8_t *matrix, const bool_t *icons)
+{
+    if (target == CAPTURE_OFF)
+    {
+        return;
+    }
+
+    uint32_t start = micros();
+    bool keyframe = force_keyframe || (seq % CAPTURE_KEYFRAME_INTERVAL) == 0;
+    if (keyframe)
+    {
+        memset(prev_frame, 0, sizeof(prev_frame));
+        force_keyframe = false;
+    }
+
+    uint8_t icon_bits = 0;
+    for (int i = 0; i < ICON_COUNT; i++)
+    {
+        icon_bits |= icons[i] ? (1 << i) : 0;
+    }
+
+    // XOR against the previous frame, keeping the current one as reference
+    uint8_t delta[CAPTURE_FRAME_SIZE];
+    for (int i = 0; i < CAPTURE_MATRIX_SIZE; i++)
+    {
+        delta[i] = matrix[i] ^ prev_frame[i];
+        prev_frame[i] = matrix[i];
+    }
+    delta[CAPTURE_MATRIX_SIZE] = icon_bits ^ prev_frame[CAPTURE_MATRIX_SIZE];
+    prev_frame[CAPTURE_MATRIX_SIZE] = icon_bits;
+
+    uint8_t packet[CAPTURE_PACKET_MAX];
+    uint8_t len = capture_packet(packet, keyframe ? CAPTURE_FLAG_KEYFRAME : 0, seq, millis(), delta);
+    seq++;
+
+    if (xRingbufferSend(ring, packet, len, 0) == pdTRUE)
+    {
+        bytes_out += len;
+    }
+    else
+    {
+        // Writer is behind. The decoder never sees this frame, so the next
+        // one can't be a delta against it.
+        dropped++;
+        force_keyframe = true;
+    }
+    frames++;
+
+    uint32_t elapsed = micros() - start;
+    encode_us_total += elapsed;
+    if (elapsed > encode_us_max)
+    {
+        encode_us_max = elapsed;
+    }
+}
+
+void capture_report()
+{
+    if (!frames)
+    {
+        return;
+    }
+    USBSerial.printf("[*] Capture: %lu frames, %lu dropped, %lu bytes (%.1f B/frame)\n",
+                     (unsigned long)frames, (unsigned long)dropped, (unsigned long)bytes_out,
+                     (float)bytes_out / (frames - dropped ? frames - dropped : 1));
+    USBSerial.printf("[*] Capture encode: avg %.1f us, max %lu us per frame\n",
+                     (float)encode_us_total / frames, (unsigned long)encode_us_max);
+}
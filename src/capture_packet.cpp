@@ -0,0 +1,69 @@
+/*
+    Frame capture packet encoder, see capture_packet.h
+*/
+
+#include "capture_packet.h"
+#include <string.h>
+
+// PackBits: 0x00-0x7F = 1-128 literal bytes follow,
+// 0x80-0xFF = the next byte repeated 2-129 times. Only runs of three or
+// more are emitted as repeats; a pair would cost as much as it saves and
+// splitting a literal around it adds a header byte.
+uint8_t capture_rle_encode(const uint8_t *src, uint8_t len, uint8_t *dst)
+{
+    uint8_t out = 0;
+    uint8_t i = 0;
+    while (i < len)
+    {
+        uint8_t run = 1;
+        while (i + run < len && run < 129 && src[i + run] == src[i])
+        {
+            run++;
+        }
+
+        if (run >= 3)
+        {
+            dst[out++] = 0x80 | (run - 2);
+            dst[out++] = src[i];
+            i += run;
+            continue;
+        }
+
+        // Literal run up to the next three equal bytes
+        uint8_t start = i;
+        while (i < len && i - start < 128 &&
+               !(i + 2 < len && src[i + 1] == src[i] && src[i + 2] == src[i]))
+        {
+            i++;
+        }
+        dst[out++] = i - start - 1;
+        memcpy(dst + out, src + start, i - start);
+        out += i - start;
+    }
+    return out;
+}
+
+// Build a complete packet for one XOR delta, returns its length
+uint8_t capture_packet(uint8_t *packet, uint8_t flags, uint16_t seq, uint32_t time_ms,
+                       const uint8_t *delta)
+{
+    packet[0] = 'T';
+    packet[1] = 'F';
+    packet[2] = flags;
+    packet[3] = seq & 0xFF;
+    packet[4] = seq >> 8;
+    packet[5] = time_ms & 0xFF;
+    packet[6] = (time_ms >> 8) & 0xFF;
+    packet[7] = (time_ms >> 16) & 0xFF;
+    packet[8] = time_ms >> 24;
+    packet[9] = capture_rle_encode(delta, CAPTURE_FRAME_SIZE, packet + 10);
+
+    uint8_t len = 10 + packet[9];
+    uint8_t checksum = 0;
+    for (int i = 2; i < len; i++)
+    {
+        checksum += packet[i];
+    }
+    packet[len++] = checksum;
+    return len;
+}
@@ -0,0 +1,134 @@
+/*
+    Input-to-pixel latency tracing, see latency.h. Everything runs on the
+    loop task, so the trace state needs no locking.
+*/
+
+#include "latency.h"
+
+typedef enum
+{
+    STAGE_SCAN = 0,
+    STAGE_EMU,
+    STAGE_DRAW,
+    STAGE_TOTAL,
+    STAGE_COUNT
+} latency_stage_t;
+
+static const char *stage_names[STAGE_COUNT] = {"scan", "emu", "draw", "total"};
+
+// Timestamps (us) of the event being traced, 0 = not reached yet
+static bool pending = false;
+static uint32_t t_edge = 0;
+static uint32_t t_set = 0;
+static uint32_t t_lcd = 0;
+
+// Ring of completed samples per stage
+static uint32_t samples[STAGE_COUNT][LATENCY_SAMPLES];
+static uint32_t sample_count = 0;
+static uint32_t timeouts = 0;
+static uint32_t overlapped = 0;
+
+static void latency_expire(uint32_t now)
+{
+    if (pending && now - t_edge > LATENCY_TIMEOUT_US)
+    {
+        pending = false;
+        timeouts++;
+    }
+}
+
+void latency_key_edge()
+{
+    uint32_t now = micros();
+    latency_expire(now);
+    if (pending)
+    {
+        overlapped++;
+        return;
+    }
+
+    pending = true;
+    t_edge = now;
+    t_set = t_lcd = 0;
+}
+
+void latency_button_set()
+{
+    if (pending && !t_set)
+    {
+        t_set = micros();
+    }
+}
+
+void latency_lcd_change()
+{
+    if (pending && t_set && !t_lcd)
+    {
+        t_lcd = micros();
+    }
+}
+
+void latency_display_pushed()
+{
+    uint32_t now = micros();
+    latency_expire(now);
+    if (!pending || !t_lcd)
+    {
+        return;
+    }
+
+    uint32_t i = sample_count % LATENCY_SAMPLES;
+    samples[STAGE_SCAN][i] = t_set - t_edge;
+    samples[STAGE_EMU][i] = t_lcd - t_set;
+    samples[STAGE_DRAW][i] = now - t_lcd;
+    samples[STAGE_TOTAL][i] = now - t_edge;
+    sample_count++;
+    pending = false;
+
+#if LATENCY_LOG_EVENTS
+    USBSerial.printf("[L] scan %.1f ms, emu %.1f ms, draw %.1f ms, total %.1f ms\n",
+                     samples[STAGE_SCAN][i] / 1000.0f, samples[STAGE_EMU][i] / 1000.0f,
+                     samples[STAGE_DRAW][i] / 1000.0f, samples[STAGE_TOTAL][i] / 1000.0f);
+#endif
+}
+
+// Nearest-rank percentile of a sorted array
+static uint32_t percentile(const uint32_t *sorted, uint32_t count, uint32_t pct)
+{
+    uint32_t rank = (pct * count + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+void latency_report()
+{
+    uint32_t count = sample_count < LATENCY_SAMPLES ? sample_count : LATENCY_SAMPLES;
+    USBSerial.printf("[*] Latency: %lu events traced, %lu without an LCD change, %lu overlapped\n",
+                     (unsigned long)sample_count, (unsigned long)timeouts, (unsigned long)overlapped);
+    if (!count)
+    {
+        return;
+    }
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        // Insertion sort, the ring is small
+        uint32_t sorted[LATENCY_SAMPLES];
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t v = samples[stage][i];
+            uint32_t j = i;
+            for (; j > 0 && sorted[j - 1] > v; j--)
+            {
+                sorted[j] = sorted[j - 1];
+            }
+            sorted[j] = v;
+        }
+
+        USBSerial.printf("[*]   %-5s p50 %6.1f  p95 %6.1f  p99 %6.1f  max %6.1f ms\n",
+                         stage_names[stage],
+                         percentile(sorted, count, 50) / 1000.0f,
+                         percentile(sorted, count, 95) / 1000.0f,
+                         percentile(sorted, count, 99) / 1000.0f,
+                         sorted[count - 1] / 1000.0f);
+    }
+}
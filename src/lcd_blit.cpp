@@ -0,0 +1,150 @@
+/*
+    1bpp to RGB565 scaling blitter used to draw the Tamagotchi LCD matrix
+    and icons. The LUT kernel is what runs on the ESP32-S3, the SIMD kernel
+    is only built for hosts with SSE2 or NEON.
+*/
+
+#include "lcd_blit.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+bool lcd_blit_init(lcd_blit_t *blit, uint8_t width, uint8_t scale, uint16_t fg, uint16_t bg)
+{
+    if (width == 0 || width > LCD_BLIT_MAX_WIDTH || width % 8 ||
+        scale == 0 || scale > LCD_BLIT_MAX_SCALE)
+    {
+        return false;
+    }
+
+    memset(blit, 0, sizeof(lcd_blit_t));
+    blit->width = width;
+    blit->scale = scale;
+    blit->fg = fg;
+    blit->bg = bg;
+
+    for (int n = 0; n < 16; n++)
+    {
+        for (int i = 0; i < 4 * scale; i++)
+        {
+            blit->nibble[n][i] = (n & (0x8 >> (i / scale))) ? fg : bg;
+        }
+    }
+
+#if LCD_BLIT_HAVE_SIMD
+    int blocks = width * scale / 8;
+    for (int k = 0; k < blocks; k++)
+    {
+        int first = (k * 8) / scale;
+        blit->block_byte[k] = first / 8;
+        for (int lane = 0; lane < 8; lane++)
+        {
+            int bit = (k * 8 + lane) / scale - blit->block_byte[k] * 8;
+            blit->block_mask[k][lane] = 0x8000 >> bit;
+        }
+    }
+#endif
+    return true;
+}
+
+void lcd_blit_row_scalar(const lcd_blit_t *blit, const uint8_t *src, uint16_t *dst)
+{
+    for (int x = 0; x < blit->width; x++)
+    {
+        uint16_t color = (src[x / 8] & (0x80 >> (x % 8))) ? blit->fg : blit->bg;
+        for (int s = 0; s < blit->scale; s++)
+        {
+            *dst++ = color;
+        }
+    }
+}
+
+void lcd_blit_row_lut(const lcd_blit_t *blit, const uint8_t *src, uint16_t *dst)
+{
+    // A nibble run is 4 * scale pixels, always a whole number of 32-bit
+    // words, so copy it word by word
+    const int words = 2 * blit->scale;
+    uint32_t *out = (uint32_t *)dst;
+
+    for (int i = 0; i < blit->width / 8; i++)
+    {
+        const uint32_t *hi = (const uint32_t *)blit->nibble[src[i] >> 4];
+        const uint32_t *lo = (const uint32_t *)blit->nibble[src[i] & 0xF];
+        for (int w = 0; w < words; w++)
+        {
+            out[w] = hi[w];
+        }
+        for (int w = 0; w < words; w++)
+        {
+            out[words + w] = lo[w];
+        }
+        out += 2 * words;
+    }
+}
+
+#if LCD_BLIT_HAVE_SIMD
+void lcd_blit_row_simd(const lcd_blit_t *blit, const uint8_t *src, uint16_t *dst)
+{
+    // Zero-padded copy so every 16-bit window can be read
+    uint8_t row[LCD_BLIT_MAX_WIDTH / 8 + 1] = {0};
+    memcpy(row, src, blit->width / 8);
+
+    const int blocks = blit->width * blit->scale / 8;
+
+#if defined(__SSE2__)
+    const __m128i fg = _mm_set1_epi16((short)blit->fg);
+    const __m128i bg = _mm_set1_epi16((short)blit->bg);
+    const __m128i zero = _mm_setzero_si128();
+    for (int k = 0; k < blocks; k++)
+    {
+        int b = blit->block_byte[k];
+        __m128i window = _mm_set1_epi16((short)((row[b] << 8) | row[b + 1]));
+        __m128i mask = _mm_loadu_si128((const __m128i *)blit->block_mask[k]);
+        __m128i off = _mm_cmpeq_epi16(_mm_and_si128(window, mask), zero);
+        __m128i px = _mm_or_si128(_mm_and_si128(off, bg), _mm_andnot_si128(off, fg));
+        _mm_storeu_si128((__m128i *)(dst + k * 8), px);
+    }
+#else
+    const uint16x8_t fg = vdupq_n_u16(blit->fg);
+    const uint16x8_t bg = vdupq_n_u16(blit->bg);
+    for (int k = 0; k < blocks; k++)
+    {
+        int b = blit->block_byte[k];
+        uint16x8_t window = vdupq_n_u16((uint16_t)((row[b] << 8) | row[b + 1]));
+        uint16x8_t mask = vld1q_u16(blit->block_mask[k]);
+        uint16x8_t on = vtstq_u16(window, mask);
+        vst1q_u16(dst + k * 8, vbslq_u16(on, fg, bg));
+    }
+#endif
+}
+#endif
+
+void lcd_blit_row(const lcd_blit_t *blit, const uint8_t *src, uint16_t *dst)
+{
+#if LCD_BLIT_HAVE_SIMD
+    lcd_blit_row_simd(blit, src, dst);
+#else
+    lcd_blit_row_lut(blit, src, dst);
+#endif
+}
+
+void lcd_blit_rows(const lcd_blit_t *blit, const uint8_t *src, uint8_t rows, uint16_t *dst)
+{
+    const int out_width = blit->width * blit->scale;
+    const int stride = blit->width / 8;
+
+    for (int y = 0; y < rows; y++)
+    {
+        // Expand once, then copy the line for the remaining scaled rows
+        lcd_blit_row(blit, src + y * stride, dst);
+        for (int s = 1; s < blit->scale; s++)
+        {
+            memcpy(dst + s * out_width, dst, out_width * sizeof(uint16_t));
+        }
+        dst += blit->scale * out_width;
+    }
+}
@@ -12,20 +12,35 @@ extern "C"
 }
 
 #include "tamalib_cardputer_hal.h"
-
-// Global ROM and state file paths
+#include "arena.h"
+#include "boot.h"
+#include "hal_dispatch.h"
+#include "latency.h"
+#include "perf.h"
+#include "pet_stats.h"
+#include "power.h"
+#include "rom_library.h"
+#include "watch.h"
+
+// Global ROM and state file paths. ROM_FILE is set from the ROM library,
+// ROM_STATE is the pre-slot save file, only read to migrate it.
 String ROM_FILE = "/tamaputer/tama.b";
 String ROM_STATE = "/tamaputer/tama.state";
 
 int TAMA_FRAMERATE = 10;
+
+// How often runtime statistics are printed over serial
+#define STATS_INTERVAL_MS 60000
+
 static timestamp_t screen_ts = 0;
+static uint32_t stats_ms = 0;
 static u32_t ts_freq;
 hal_t *g_hal;
 
 // HAL functions structure for tamalib (must match order in hal.h)
 static hal_t hal = {
-    .malloc = malloc,
-    .free = free,
+    .malloc = arena_malloc,
+    .free = arena_free,
     .halt = hal_halt,
     .is_log_enabled = hal_is_log_enabled,
     .log = hal_log,
@@ -41,14 +56,16 @@ static hal_t hal = {
 
 void setup()
 {
+    boot_mark(BOOT_START);
+
     // Initialize USB Serial for debugging FIRST (ESP32-S3 uses USBSerial)
     USBSerial.begin(115200);
-    delay(500);
     USBSerial.println("\n\n=== TAMAPUTER STARTING ===");
 
     // Initialize M5Cardputer
     auto cfg = M5.config();
     M5Cardputer.begin(cfg);
+    boot_mark(BOOT_DISPLAY_READY);
 
     // Initialize speaker
     M5Cardputer.Speaker.begin();
@@ -67,18 +84,48 @@ void setup()
     M5Cardputer.Display.setTextColor(TFT_WHITE);
     M5Cardputer.Display.setTextSize(2);
 
-    M5Cardputer.Display.setCursor(5, 60);
+    // Four 16 px lines, the last one ending above the 135 px screen edge
+    M5Cardputer.Display.setCursor(5, 54);
     M5Cardputer.Display.println("Hold");
-    M5Cardputer.Display.setCursor(5, 80);
+    M5Cardputer.Display.setCursor(5, 72);
     M5Cardputer.Display.println("  ESC: Help");
-    M5Cardputer.Display.setCursor(5, 100);
+    M5Cardputer.Display.setCursor(5, 90);
     M5Cardputer.Display.println("  SPACE: New Game");
-    delay(2500);
+    M5Cardputer.Display.setCursor(5, 108);
+    M5Cardputer.Display.println("  R: ROMs");
+    boot_mark(BOOT_SPLASH_SHOWN);
+
+    // Load ROM and save state in the background while the splash is up
+    uint32_t splash_start = millis();
+    bool keySelectRom = false;
+    boot_start_loader();
+    while (!boot_loader_done() || millis() - splash_start < BOOT_SPLASH_MIN_MS)
+    {
+        M5Cardputer.update();
+        keySelectRom |= M5Cardputer.Keyboard.isKeyPressed(M5_BTN_ROMS);
+        delay(10);
+    }
+    boot_mark(BOOT_SPLASH_DONE);
     M5Cardputer.Display.fillScreen(TFT_BLACK);
 
-    // Show ROM file selection menu
+    // Ask which ROM to run if R was held or the last one can't be started
+    boot_result_t *boot = boot_result();
+    while (keySelectRom || (!boot->rom_data && rom_library_ready_count()))
+    {
+        keySelectRom = false;
+        bool picked = boot_select_rom();
+        M5Cardputer.Display.fillScreen(TFT_BLACK);
+        if (!picked)
+        {
+            break;
+        }
+    }
+    if (!boot->rom_data)
+    {
+        rom_error();
+    }
+
     M5Cardputer.update();
-    u12_t *rom_data = load_rom();
     bool keyStartNewGame =
         M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER) ||
         M5Cardputer.Keyboard.isKeyPressed(' ');
@@ -89,29 +136,48 @@ void setup()
     tamalib_register_hal(&hal);
     tamalib_set_framerate(TAMA_FRAMERATE);
     ts_freq = 1000000; // 1MHz
-    tamalib_init(rom_data, NULL, ts_freq);
+    tamalib_init(boot->rom_data, NULL, ts_freq);
     USBSerial.println("Done.");
 
-    // Load saved state if it exists
+    // Apply the pre-read saved state if it exists
     if (keyStartNewGame)
     {
         display_help();
     }
-    else
+    else if (boot->state_found)
     {
-        load_from_state();
+        apply_state_file(&boot->state);
     }
+    free_state_file(&boot->state);
+    pet_stats_init();
+    power_init();
+    arena_report();
+    boot_mark(BOOT_EMU_READY);
 }
 
 void loop()
 {
     timestamp_t ts;
-    g_hal->handler();
+    HAL_CALL(handler)();
     tamalib_step();
-    ts = g_hal->get_timestamp();
-    if (ts - screen_ts >= ts_freq / 10)
+    perf_steps++;
+    ts = HAL_CALL(get_timestamp)();
+    if (ts - screen_ts >= ts_freq / power_frame_rate())
     {
         screen_ts = ts;
-        g_hal->update_screen();
+        watch_poll();
+        HAL_CALL(update_screen)();
+        boot_first_frame();
+        power_update();
+    }
+
+    if (millis() - stats_ms >= STATS_INTERVAL_MS)
+    {
+        stats_ms = millis();
+        perf_report();
+        power_report();
+        arena_report();
+        latency_report();
+        pet_stats_flush();
     }
 }
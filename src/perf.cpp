@@ -0,0 +1,32 @@
+/*
+    Emulator throughput report, see perf.h
+*/
+
+#include "perf.h"
+#include "hal_dispatch.h"
+
+uint32_t perf_steps = 0;
+uint32_t perf_wait_us = 0;
+
+static uint32_t last_us = 0;
+
+// Rates since the previous report
+void perf_report()
+{
+    uint32_t now = micros();
+    uint32_t elapsed = now - last_us;
+    uint32_t steps = perf_steps;
+    uint32_t wait = perf_wait_us < elapsed ? perf_wait_us : elapsed;
+    uint32_t busy = elapsed - wait;
+    last_us = now;
+    perf_steps = 0;
+    perf_wait_us = 0;
+
+    if (!elapsed || !busy)
+    {
+        return;
+    }
+    USBSerial.printf("[*] Emulator (%s build, %lu MHz): %.0f steps/s, %.1f%% busy, %.0f steps/s achievable\n",
+                     TAMA_BUILD_NAME, (unsigned long)getCpuFrequencyMhz(),
+                     steps * 1e6 / elapsed, 100.0 * busy / elapsed, steps * 1e6 / busy);
+}
@@ -0,0 +1,187 @@
+/*
+    Pet statistics HUD and analytics log, see pet_stats.h
+*/
+
+#include "pet_stats.h"
+#include "watch.h"
+#include <SD.h>
+
+// Free column to the right of the scaled LCD
+#define HUD_X 184
+#define HUD_Y 10
+#define HUD_WIDTH 56
+#define HUD_LINE 13
+
+typedef struct
+{
+    char name[PET_STATS_NAME_SIZE];
+    int watch;
+} pet_stat_t;
+
+static pet_stat_t stats[PET_STATS_MAX];
+static uint8_t stat_count = 0;
+static bool hud_dirty = true;
+
+// Buffered CSV lines not yet on the card
+static char log_buffer[PET_STATS_LOG_BUFFER];
+static size_t log_used = 0;
+
+static void pet_stats_log(const pet_stat_t *stat, uint16_t value)
+{
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%lu,%lu,%s,%u\n",
+                       (unsigned long)(millis() / 1000), (unsigned long)time(NULL),
+                       stat->name, value);
+    if (len <= 0 || len >= (int)sizeof(line))
+    {
+        return;
+    }
+    if (log_used + len > sizeof(log_buffer))
+    {
+        pet_stats_flush();
+    }
+    if (log_used + len > sizeof(log_buffer))
+    {
+        return; // Card unavailable, drop the line
+    }
+    memcpy(log_buffer + log_used, line, len);
+    log_used += len;
+}
+
+static void pet_stats_changed(int id, uint16_t value, uint16_t old, void *ctx)
+{
+    pet_stats_log((const pet_stat_t *)ctx, value);
+    hud_dirty = true;
+}
+
+// Parse "name address [nibbles]" lines into watches
+static void pet_stats_parse(File &file)
+{
+    char line[64];
+    size_t len = 0;
+    while (true)
+    {
+        int c = file.read();
+        if (c >= 0 && c != '\n' && len < sizeof(line) - 1)
+        {
+            line[len++] = c;
+            continue;
+        }
+        if (c < 0 && len == 0)
+        {
+            break;
+        }
+        line[len] = '\0';
+        len = 0;
+
+        char name[PET_STATS_NAME_SIZE];
+        unsigned int addr;
+        int nibbles = 1;
+        if (line[0] == '#' || sscanf(line, "%11s %x %d", name, &addr, &nibbles) < 2)
+        {
+            continue;
+        }
+        if (stat_count == PET_STATS_MAX)
+        {
+            USBSerial.printf("[!] Stats map: more than %d entries, ignoring %s\n", PET_STATS_MAX, name);
+            continue;
+        }
+
+        // Check before narrowing to u12_t, or 0x10080 would pass as 0x080
+        if (addr >= MEMORY_SIZE || nibbles < 1 || nibbles > 4)
+        {
+            USBSerial.printf("[!] Stats map: %s 0x%x %d out of range (RAM 0x%03x, 1-4 nibbles)\n",
+                             name, addr, nibbles, MEMORY_SIZE);
+            continue;
+        }
+
+        pet_stat_t *stat = &stats[stat_count];
+        stat->watch = watch_add(addr, nibbles, pet_stats_changed, stat);
+        if (stat->watch == WATCH_NONE)
+        {
+            USBSerial.printf("[!] Stats map: bad entry %s 0x%03x %d\n", name, addr, nibbles);
+            continue;
+        }
+        strcpy(stat->name, name);
+        pet_stats_log(stat, watch_value(stat->watch));
+        stat_count++;
+    }
+}
+
+// Load the map for the current ROM, must be called after tamalib_init()
+void pet_stats_init()
+{
+    char path[48];
+    snprintf(path, sizeof(path), PET_STATS_MAP_DIR "/%08lx.map", (unsigned long)rom_crc);
+
+    if (!sd_mount())
+    {
+        return;
+    }
+    File file = SD.open(path, FILE_READ);
+    if (file)
+    {
+        pet_stats_parse(file);
+        file.close();
+    }
+    sd_unmount();
+
+    if (stat_count)
+    {
+        USBSerial.printf("[*] Stats map %s: %d entries\n", path, stat_count);
+    }
+    else
+    {
+        USBSerial.printf("[*] No stats map at %s\n", path);
+    }
+    hud_dirty = true;
+}
+
+void pet_stats_invalidate()
+{
+    hud_dirty = true;
+}
+
+void pet_stats_draw()
+{
+    if (!hud_dirty || !stat_count)
+    {
+        return;
+    }
+    hud_dirty = false;
+
+    M5Cardputer.Display.fillRect(HUD_X, HUD_Y, HUD_WIDTH, PET_STATS_MAX * HUD_LINE, TFT_BLACK);
+    M5Cardputer.Display.setTextSize(1);
+    M5Cardputer.Display.setTextColor(TFT_WHITE);
+    for (int i = 0; i < stat_count; i++)
+    {
+        M5Cardputer.Display.setCursor(HUD_X, HUD_Y + i * HUD_LINE);
+        M5Cardputer.Display.printf("%-4.4s%4u", stats[i].name, watch_value(stats[i].watch));
+    }
+}
+
+void pet_stats_flush()
+{
+    if (!log_used || !sd_mount())
+    {
+        return;
+    }
+
+    bool created = !SD.exists(PET_STATS_LOG_FILE);
+    File file = SD.open(PET_STATS_LOG_FILE, FILE_APPEND);
+    if (file)
+    {
+        if (created)
+        {
+            file.print("uptime_s,time,name,value\n");
+        }
+        file.write((const uint8_t *)log_buffer, log_used);
+        file.close();
+        log_used = 0;
+    }
+    else
+    {
+        USBSerial.println("[!] Stats log open failed!");
+    }
+    sd_unmount();
+}
@@ -0,0 +1,126 @@
+/*
+    Idle power governor. Levels only change from the loop task, so the
+    CPU clock is never switched under the emulator's feet.
+*/
+
+#include "power.h"
+#include <M5Cardputer.h>
+
+typedef struct
+{
+    const char *name;
+    uint32_t cpu_mhz;
+    uint8_t brightness; // 0 = the brightness the display started with
+    uint8_t frame_rate;
+} power_profile_t;
+
+static const power_profile_t profiles[POWER_LEVEL_COUNT] = {
+    {"full", 240, 0, 10},
+    {"dim", 160, 32, 5},
+    {"sleep", 80, 8, 2},
+};
+
+static power_level_t level = POWER_FULL;
+static uint8_t full_brightness = 0;
+static uint32_t last_activity = 0;
+static uint32_t level_since = 0;
+static uint32_t level_ms[POWER_LEVEL_COUNT] = {0};
+static uint32_t wakeups = 0;
+
+// Frames handed to the display vs skipped because nothing changed
+static uint32_t frames_drawn = 0;
+static uint32_t frames_skipped = 0;
+
+static void power_set_level(power_level_t new_level)
+{
+    if (new_level == level)
+    {
+        return;
+    }
+
+    uint32_t now = millis();
+    level_ms[level] += now - level_since;
+    level_since = now;
+    level = new_level;
+
+    const power_profile_t *p = &profiles[level];
+    setCpuFrequencyMhz(p->cpu_mhz);
+    M5Cardputer.Display.setBrightness(p->brightness ? p->brightness : full_brightness);
+    USBSerial.printf("[*] Power: %s (%lu MHz)\n", p->name, (unsigned long)getCpuFrequencyMhz());
+}
+
+void power_init()
+{
+    full_brightness = M5Cardputer.Display.getBrightness();
+    last_activity = level_since = millis();
+    setCpuFrequencyMhz(profiles[POWER_FULL].cpu_mhz);
+}
+
+// Keypress or buzzer: straight back to full power
+void power_activity()
+{
+    last_activity = millis();
+    if (level != POWER_FULL)
+    {
+        wakeups++;
+        power_set_level(POWER_FULL);
+    }
+}
+
+void power_update()
+{
+    uint32_t idle = millis() - last_activity;
+    if (idle >= POWER_SLEEP_AFTER_MS)
+    {
+        power_set_level(POWER_SLEEP);
+    }
+    else if (idle >= POWER_DIM_AFTER_MS)
+    {
+        power_set_level(POWER_DIM);
+    }
+}
+
+void power_frame(bool changed)
+{
+    if (changed)
+    {
+        frames_drawn++;
+    }
+    else
+    {
+        frames_skipped++;
+    }
+}
+
+power_level_t power_level()
+{
+    return level;
+}
+
+uint8_t power_frame_rate()
+{
+    return profiles[level].frame_rate;
+}
+
+void power_report()
+{
+    uint32_t now = millis();
+    uint32_t total = now - level_since;
+    for (int i = 0; i < POWER_LEVEL_COUNT; i++)
+    {
+        total += level_ms[i];
+    }
+    total = total ? total : 1;
+
+    USBSerial.printf("[*] Power: %s, %lu MHz, idle %lu s, %lu wakeups\n",
+                     profiles[level].name, (unsigned long)getCpuFrequencyMhz(),
+                     (unsigned long)((now - last_activity) / 1000), (unsigned long)wakeups);
+    for (int i = 0; i < POWER_LEVEL_COUNT; i++)
+    {
+        uint32_t ms = level_ms[i] + (i == level ? now - level_since : 0);
+        USBSerial.printf("[*]   %-5s %8lu s  %5.1f%%\n", profiles[i].name,
+                         (unsigned long)(ms / 1000), 100.0f * ms / total);
+    }
+    USBSerial.printf("[*] Frames: %lu drawn, %lu unchanged and skipped\n",
+                     (unsigned long)frames_drawn, (unsigned long)frames_skipped);
+}
@@ -0,0 +1,304 @@
+/*
+    ROM library index and boot selector, see rom_library.h
+*/
+
+#include "rom_library.h"
+#include <SD.h>
+#include <esp_rom_crc.h>
+
+static rom_entry_t entries[ROM_LIBRARY_MAX];
+static uint8_t entry_count = 0;
+static uint32_t last_crc = 0;
+
+static bool rom_library_write()
+{
+    File indexFile = SD.open(ROM_LIBRARY_INDEX, FILE_WRITE);
+    if (!indexFile)
+    {
+        USBSerial.println("[!] ROM index write failed!");
+        return false;
+    }
+
+    rom_index_header_t header = {ROM_INDEX_MAGIC, ROM_INDEX_VERSION, entry_count, {0, 0}, last_crc};
+    indexFile.write((uint8_t *)&header, sizeof(header));
+    indexFile.write((uint8_t *)entries, sizeof(rom_entry_t) * entry_count);
+    indexFile.close();
+    return true;
+}
+
+// Number of entries that can be started
+uint8_t rom_library_ready_count()
+{
+    uint8_t ready = 0;
+    for (int i = 0; i < entry_count; i++)
+    {
+        ready += entries[i].status == ROM_READY;
+    }
+    return ready;
+}
+
+// Read the index (SD must be mounted). The card is scanned if there is
+// no index or it lists nothing that can be started, so ROMs copied on
+// after a boot without any are picked up.
+bool rom_library_load()
+{
+    entry_count = 0;
+
+    File indexFile = SD.open(ROM_LIBRARY_INDEX, FILE_READ);
+    if (indexFile)
+    {
+        rom_index_header_t header;
+        bool valid =
+            indexFile.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == ROM_INDEX_MAGIC &&
+            header.version == ROM_INDEX_VERSION &&
+            header.count <= ROM_LIBRARY_MAX &&
+            indexFile.read((uint8_t *)entries, sizeof(rom_entry_t) * header.count) ==
+                sizeof(rom_entry_t) * header.count;
+        indexFile.close();
+
+        if (valid)
+        {
+            entry_count = header.count;
+            last_crc = header.last_crc;
+            if (rom_library_ready_count())
+            {
+                return true;
+            }
+        }
+    }
+    return rom_library_scan();
+}
+
+// Size and CRC32 of one ROM file, same CRC as load_rom() computes
+static void rom_library_add(File &file)
+{
+    if (entry_count == ROM_LIBRARY_MAX)
+    {
+        USBSerial.printf("[!] More than %d ROMs, skipping %s\n", ROM_LIBRARY_MAX, file.path());
+        return;
+    }
+    if (strlen(file.path()) >= ROM_PATH_SIZE)
+    {
+        USBSerial.printf("[!] ROM path too long, skipping %s\n", file.path());
+        return;
+    }
+
+    rom_entry_t *entry = &entries[entry_count++];
+    memset(entry, 0, sizeof(rom_entry_t));
+    strcpy(entry->path, file.path());
+    entry->size = file.size();
+    entry->status = ROM_READY;
+
+    if (entry->size != ROM_SIZE)
+    {
+        entry->status = ROM_BAD_SIZE;
+        return;
+    }
+
+    uint8_t buf[512];
+    size_t remaining = entry->size;
+    while (remaining)
+    {
+        size_t n = file.read(buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+        if (!n)
+        {
+            entry->status = ROM_UNREADABLE;
+            return;
+        }
+        entry->crc = esp_rom_crc32_le(entry->crc, buf, n);
+        remaining -= n;
+    }
+}
+
+// Hash every ROM on the card and rewrite the index (SD must be mounted)
+bool rom_library_scan()
+{
+    uint32_t start = millis();
+    entry_count = 0;
+
+    File dir = SD.open(ROM_LIBRARY_DIR);
+    if (dir && dir.isDirectory())
+    {
+        File file;
+        while ((file = dir.openNextFile()))
+        {
+            if (!file.isDirectory())
+            {
+                rom_library_add(file);
+            }
+            file.close();
+        }
+    }
+    if (dir)
+    {
+        dir.close();
+    }
+
+    File legacy = SD.open(ROM_LEGACY_FILE, FILE_READ);
+    if (legacy)
+    {
+        rom_library_add(legacy);
+        legacy.close();
+    }
+
+    USBSerial.printf("[*] ROM library: %d ROMs indexed in %lu ms\n",
+                     entry_count, (unsigned long)(millis() - start));
+    rom_library_write();
+    return entry_count > 0;
+}
+
+const rom_entry_t *rom_library_entry(int index)
+{
+    return (index >= 0 && index < entry_count) ? &entries[index] : NULL;
+}
+
+// The ROM to start without asking: the last one used, or the only one
+int rom_library_default()
+{
+    int ready = -1;
+    int ready_count = 0;
+    for (int i = 0; i < entry_count; i++)
+    {
+        if (entries[i].status != ROM_READY)
+        {
+            continue;
+        }
+        if (entries[i].crc == last_crc)
+        {
+            return i;
+        }
+        ready = i;
+        ready_count++;
+    }
+    return ready_count == 1 ? ready : -1;
+}
+
+// Remember the ROM that was started (SD must be mounted)
+void rom_library_set_last(uint32_t crc)
+{
+    if (crc != last_crc)
+    {
+        last_crc = crc;
+        rom_library_write();
+    }
+}
+
+static const char *rom_name(const rom_entry_t *entry)
+{
+    const char *slash = strrchr(entry->path, '/');
+    return slash ? slash + 1 : entry->path;
+}
+
+#define SELECTOR_ROWS 10
+#define SELECTOR_ROW_HEIGHT 12
+
+static void draw_rom_selector(int selected)
+{
+    M5Cardputer.Display.fillScreen(TFT_BLACK);
+    M5Cardputer.Display.setTextSize(1);
+
+    M5Cardputer.Display.setTextColor(TFT_YELLOW);
+    M5Cardputer.Display.setCursor(4, 2);
+    M5Cardputer.Display.println("ENTER:Start  R:Rescan  ESC:Back");
+
+    if (!entry_count)
+    {
+        M5Cardputer.Display.setTextColor(TFT_WHITE);
+        M5Cardputer.Display.setCursor(4, 20);
+        M5Cardputer.Display.println("No ROMs in " ROM_LIBRARY_DIR);
+        return;
+    }
+
+    int top = selected >= SELECTOR_ROWS ? selected - SELECTOR_ROWS + 1 : 0;
+    for (int row = 0; row < SELECTOR_ROWS && top + row < entry_count; row++)
+    {
+        int i = top + row;
+        uint16_t y = 16 + row * SELECTOR_ROW_HEIGHT;
+        bool ready = entries[i].status == ROM_READY;
+
+        if (i == selected)
+        {
+            M5Cardputer.Display.fillRect(0, y - 2, 240, SELECTOR_ROW_HEIGHT, TFT_DARKGREEN);
+        }
+        M5Cardputer.Display.setTextColor(!ready ? TFT_DARKGREY : entries[i].crc == last_crc ? TFT_GREEN
+                                                                                            : TFT_WHITE);
+        M5Cardputer.Display.setCursor(4, y);
+        M5Cardputer.Display.printf("%-28.28s", rom_name(&entries[i]));
+        M5Cardputer.Display.setCursor(178, y);
+        if (ready)
+        {
+            M5Cardputer.Display.printf("%08lx", (unsigned long)entries[i].crc);
+        }
+        else
+        {
+            M5Cardputer.Display.print(entries[i].status == ROM_BAD_SIZE ? "bad size" : "unreadable");
+        }
+    }
+}
+
+// Pick a ROM from the index and return its entry. Only reads the index;
+// ESC returns preselected, -1 if nothing was.
+int rom_library_select(int preselected)
+{
+    // Wait for the key held during the splash to be released
+    while (M5Cardputer.Keyboard.isPressed())
+    {
+        M5Cardputer.update();
+        delay(10);
+    }
+
+    int selected = preselected >= 0 ? preselected : 0;
+    draw_rom_selector(selected);
+
+    while (true)
+    {
+        M5Cardputer.update();
+
+        if (M5Cardputer.Keyboard.isChange() && M5Cardputer.Keyboard.isPressed())
+        {
+            if (M5Cardputer.Keyboard.isKeyPressed(';') && selected > 0) // Up
+            {
+                selected--;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed('.') && selected + 1 < entry_count) // Down
+            {
+                selected++;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER) &&
+                     selected < entry_count && entries[selected].status == ROM_READY)
+            {
+                return selected;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed(M5_BTN_ROMS))
+            {
+                M5Cardputer.Display.fillScreen(TFT_BLACK);
+                M5Cardputer.Display.setTextColor(TFT_WHITE);
+                M5Cardputer.Display.setCursor(4, 60);
+                M5Cardputer.Display.println("Scanning ROMs...");
+                if (sd_mount())
+                {
+                    rom_library_scan();
+                    sd_unmount();
+                }
+                selected = 0;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed(M5_BTN_HELP) ||
+                     M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE))
+            {
+                return preselected;
+            }
+
+            draw_rom_selector(selected);
+
+            // Wait for key release
+            while (M5Cardputer.Keyboard.isPressed())
+            {
+                M5Cardputer.update();
+                delay(10);
+            }
+        }
+
+        delay(10);
+    }
+}
@@ -0,0 +1,393 @@
+/*
+    Numbered save slots. Each slot is its own state file, and a small index
+    file holds one fixed-size record per slot (timestamp, ROM hash, play time
+    and a LCD thumbnail) so the picker never has to open the state files.
+
+    Slots and their index live in a directory per ROM, named after the ROM's
+    CRC32, so a state can never be loaded against a different ROM.
+*/
+
+#include "save_slots.h"
+#include <M5Cardputer.h>
+#include <SD.h>
+#include "rom_library.h"
+
+#define SLOT_SAVES_DIR "/tamaputer/saves"
+
+// Flat slot layout used before saves were split per ROM
+#define SLOT_LEGACY_INDEX "/tamaputer/slots.idx"
+
+// External variables from main.cpp
+extern String ROM_STATE;
+extern String ROM_FILE;
+
+uint8_t active_slot = 0;
+
+static uint32_t play_time_base = 0;
+static uint32_t play_time_start = 0;
+
+// Save directory of the loaded ROM
+static String slot_dir()
+{
+    char name[9];
+    snprintf(name, sizeof(name), "%08lx", (unsigned long)rom_crc);
+    return String(SLOT_SAVES_DIR "/") + name;
+}
+
+static String slot_index_path()
+{
+    return slot_dir() + "/slots.idx";
+}
+
+static String slot_legacy_path(uint8_t slot)
+{
+    return String("/tamaputer/slot") + String(slot) + ".state";
+}
+
+String slot_state_path(uint8_t slot)
+{
+    return slot_dir() + "/slot" + String(slot) + ".state";
+}
+
+// Create the loaded ROM's save directory if needed (SD must be mounted)
+bool slot_dir_create()
+{
+    String dir = slot_dir();
+    if (SD.exists(dir.c_str()))
+    {
+        return true;
+    }
+    if (!SD.exists(SLOT_SAVES_DIR))
+    {
+        SD.mkdir(SLOT_SAVES_DIR);
+    }
+    return SD.mkdir(dir.c_str());
+}
+
+// Start counting play time from a previously saved amount (in seconds)
+void slot_play_time_reset(uint32_t base)
+{
+    play_time_base = base;
+    play_time_start = millis();
+}
+
+uint32_t slot_play_time()
+{
+    return play_time_base + (millis() - play_time_start) / 1000;
+}
+
+static bool slot_index_read_file(const char *path, slot_info_t *slots, uint8_t *last_slot)
+{
+    memset(slots, 0, sizeof(slot_info_t) * SAVE_SLOT_COUNT);
+
+    File indexFile = SD.open(path, FILE_READ);
+    if (!indexFile)
+    {
+        return false;
+    }
+
+    slot_index_header_t header;
+    bool valid =
+        indexFile.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+        header.magic == SLOT_INDEX_MAGIC &&
+        header.version == SLOT_INDEX_VERSION &&
+        header.slot_count == SAVE_SLOT_COUNT;
+
+    if (valid)
+    {
+        valid = indexFile.read((uint8_t *)slots, sizeof(slot_info_t) * SAVE_SLOT_COUNT) ==
+                sizeof(slot_info_t) * SAVE_SLOT_COUNT;
+        if (valid && last_slot && header.active_slot < SAVE_SLOT_COUNT)
+        {
+            *last_slot = header.active_slot;
+        }
+    }
+    indexFile.close();
+
+    if (!valid)
+    {
+        memset(slots, 0, sizeof(slot_info_t) * SAVE_SLOT_COUNT);
+    }
+    return valid;
+}
+
+// Read the loaded ROM's whole index (SD must be mounted). Missing or invalid
+// index leaves every slot marked unused.
+bool slot_index_read(slot_info_t *slots, uint8_t *last_slot)
+{
+    return slot_index_read_file(slot_index_path().c_str(), slots, last_slot);
+}
+
+// Create an empty index with every slot unused
+static bool slot_index_create()
+{
+    if (!slot_dir_create())
+    {
+        return false;
+    }
+
+    File indexFile = SD.open(slot_index_path().c_str(), FILE_WRITE);
+    if (!indexFile)
+    {
+        return false;
+    }
+
+    slot_index_header_t header = {SLOT_INDEX_MAGIC, SLOT_INDEX_VERSION, SAVE_SLOT_COUNT, 0, 0};
+    slot_info_t empty;
+    memset(&empty, 0, sizeof(empty));
+
+    indexFile.write((uint8_t *)&header, sizeof(header));
+    for (int i = 0; i < SAVE_SLOT_COUNT; i++)
+    {
+        indexFile.write((uint8_t *)&empty, sizeof(empty));
+    }
+    indexFile.close();
+    return true;
+}
+
+// Rewrite a single slot record and the active slot in place (SD must be mounted)
+bool slot_index_update(uint8_t slot, const slot_info_t *info)
+{
+    if (slot >= SAVE_SLOT_COUNT)
+    {
+        return false;
+    }
+
+    String indexPath = slot_index_path();
+    File indexFile = SD.open(indexPath.c_str(), "r+");
+    slot_index_header_t header;
+    if (!indexFile ||
+        indexFile.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != SLOT_INDEX_MAGIC ||
+        header.version != SLOT_INDEX_VERSION ||
+        header.slot_count != SAVE_SLOT_COUNT)
+    {
+        if (indexFile)
+        {
+            indexFile.close();
+        }
+        if (!slot_index_create())
+        {
+            return false;
+        }
+        indexFile = SD.open(indexPath.c_str(), "r+");
+        if (!indexFile)
+        {
+            return false;
+        }
+    }
+
+    header = {SLOT_INDEX_MAGIC, SLOT_INDEX_VERSION, SAVE_SLOT_COUNT, slot, 0};
+    indexFile.seek(0);
+    indexFile.write((uint8_t *)&header, sizeof(header));
+    indexFile.seek(sizeof(header) + slot * sizeof(slot_info_t));
+    indexFile.write((const uint8_t *)info, sizeof(slot_info_t));
+    indexFile.close();
+
+    active_slot = slot;
+    return true;
+}
+
+// Move one legacy state file into the loaded ROM's save directory
+static bool slot_migrate_file(const char *from, uint8_t slot, const slot_info_t *info)
+{
+    String to = slot_state_path(slot);
+    if (!slot_dir_create() || !SD.rename(from, to.c_str()))
+    {
+        USBSerial.printf("[!] Could not move %s to %s\n", from, to.c_str());
+        return false;
+    }
+    USBSerial.printf("[*] Moved %s to %s\n", from, to.c_str());
+    return slot_index_update(slot, info);
+}
+
+// Move saves from the flat pre-ROM-library layout into the loaded ROM's
+// save directory (SD must be mounted). Only slots whose recorded ROM hash
+// matches are moved; the rest wait for their own ROM to be loaded.
+void slot_migrate_legacy()
+{
+    if (SD.exists(slot_index_path().c_str()))
+    {
+        return;
+    }
+
+    uint8_t last_slot = 0;
+    slot_info_t slots[SAVE_SLOT_COUNT];
+    slot_index_read_file(SLOT_LEGACY_INDEX, slots, &last_slot);
+
+    // The single pre-slot save has no ROM hash, it belongs to tama.b
+    String legacy = slot_legacy_path(0);
+    if (ROM_FILE == ROM_LEGACY_FILE && SD.exists(ROM_STATE.c_str()) &&
+        !(slots[0].used && slots[0].rom_hash == rom_crc && SD.exists(legacy.c_str())))
+    {
+        slot_info_t info;
+        memset(&info, 0, sizeof(info));
+        info.used = 1;
+        info.rom_hash = rom_crc;
+        slot_migrate_file(ROM_STATE.c_str(), 0, &info);
+    }
+
+    // The most recently used slot goes last so it stays the active one
+    for (int n = 1; n <= SAVE_SLOT_COUNT; n++)
+    {
+        uint8_t slot = (last_slot + n) % SAVE_SLOT_COUNT;
+        legacy = slot_legacy_path(slot);
+        if (slots[slot].used && slots[slot].rom_hash == rom_crc && SD.exists(legacy.c_str()))
+        {
+            slot_migrate_file(legacy.c_str(), slot, &slots[slot]);
+        }
+    }
+}
+
+static void draw_thumbnail(uint16_t x, uint16_t y, const uint8_t *thumb)
+{
+    // Draw the 32x16 thumbnail at 2x scale
+    M5Cardputer.Display.fillRect(x, y, LCD_WIDTH * 2, LCD_HEIGHT * 2, TFT_BLACK);
+    for (int ty = 0; ty < LCD_HEIGHT; ty++)
+    {
+        for (int tx = 0; tx < LCD_WIDTH; tx++)
+        {
+            if (thumb[ty * (LCD_WIDTH / 8) + tx / 8] & (0x80 >> (tx % 8)))
+            {
+                M5Cardputer.Display.fillRect(x + tx * 2, y + ty * 2, 2, 2, TFT_WHITE);
+            }
+        }
+    }
+}
+
+static void draw_slot_picker(const slot_info_t *slots, uint8_t selected)
+{
+    M5Cardputer.Display.fillScreen(TFT_BLACK);
+    M5Cardputer.Display.setTextSize(1);
+
+    // 2x2 grid of 120x62 cells below a one-line header
+    M5Cardputer.Display.setTextColor(TFT_YELLOW);
+    M5Cardputer.Display.setCursor(4, 2);
+    M5Cardputer.Display.println("ENTER:Load  Z:Save  ESC:Back");
+
+    for (uint8_t i = 0; i < SAVE_SLOT_COUNT; i++)
+    {
+        uint16_t cellX = (i % 2) * 120;
+        uint16_t cellY = 12 + (i / 2) * 62;
+
+        if (i == selected)
+        {
+            M5Cardputer.Display.drawRect(cellX + 1, cellY + 1, 118, 60, TFT_GREEN);
+        }
+
+        M5Cardputer.Display.setTextColor(i == active_slot ? TFT_GREEN : TFT_WHITE);
+        M5Cardputer.Display.setCursor(cellX + 6, cellY + 5);
+        M5Cardputer.Display.printf("Slot %d", i + 1);
+
+        if (!slots[i].used)
+        {
+            M5Cardputer.Display.setCursor(cellX + 6, cellY + 25);
+            M5Cardputer.Display.setTextColor(TFT_DARKGREY);
+            M5Cardputer.Display.println("Empty");
+            continue;
+        }
+
+        draw_thumbnail(cellX + 50, cellY + 22, slots[i].thumb);
+
+        uint32_t minutes = slots[i].play_time / 60;
+        M5Cardputer.Display.setTextColor(TFT_WHITE);
+        M5Cardputer.Display.setCursor(cellX + 6, cellY + 25);
+        M5Cardputer.Display.printf("%luh", (unsigned long)(minutes / 60));
+        M5Cardputer.Display.setCursor(cellX + 6, cellY + 35);
+        M5Cardputer.Display.printf("%02lum", (unsigned long)(minutes % 60));
+        if (slots[i].rom_hash != rom_crc)
+        {
+            M5Cardputer.Display.setTextColor(TFT_RED);
+            M5Cardputer.Display.setCursor(cellX + 6, cellY + 45);
+            M5Cardputer.Display.println("ROM?");
+        }
+    }
+}
+
+void slot_picker()
+{
+    slot_info_t slots[SAVE_SLOT_COUNT];
+
+    // Only the index is read here, never the state files themselves
+    if (sd_mount())
+    {
+        slot_index_read(slots);
+        sd_unmount();
+    }
+    else
+    {
+        memset(slots, 0, sizeof(slots));
+    }
+
+    // Wait for the picker key release
+    while (M5Cardputer.Keyboard.isPressed())
+    {
+        M5Cardputer.update();
+        delay(10);
+    }
+
+    uint8_t selected = active_slot;
+    draw_slot_picker(slots, selected);
+
+    bool done = false;
+    while (!done)
+    {
+        M5Cardputer.update();
+
+        if (M5Cardputer.Keyboard.isChange() && M5Cardputer.Keyboard.isPressed())
+        {
+            if (M5Cardputer.Keyboard.isKeyPressed(';') && selected >= 2) // Up
+            {
+                selected -= 2;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed('.') && selected + 2 < SAVE_SLOT_COUNT) // Down
+            {
+                selected += 2;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed(',') && selected > 0) // Left
+            {
+                selected--;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed('/') && selected + 1 < SAVE_SLOT_COUNT) // Right
+            {
+                selected++;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER))
+            {
+                if (slots[selected].used)
+                {
+                    load_state_slot(selected);
+                    done = true;
+                }
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed(M5_BTN_SAVE))
+            {
+                active_slot = selected;
+                save_state();
+                done = true;
+            }
+            else if (M5Cardputer.Keyboard.isKeyPressed(M5_BTN_HELP) ||
+                     M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE))
+            {
+                done = true;
+            }
+
+            if (!done)
+            {
+                draw_slot_picker(slots, selected);
+            }
+
+            // Wait for key release
+            while (M5Cardputer.Keyboard.isPressed())
+            {
+                M5Cardputer.update();
+                delay(10);
+            }
+        }
+
+        delay(10);
+    }
+
+    display_invalidate();
+    update_display();
+}
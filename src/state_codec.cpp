@@ -0,0 +1,559 @@
+/*
+    Compact save state encoder/decoder, see state_codec.h for the format.
+    The compressor is a greedy LZ77 with a 256-entry hash table (512 bytes
+    of stack), which is plenty for ~2 KB of mostly idle RAM.
+*/
+
+#include "state_codec.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7F + LZ_MIN_MATCH)
+#define LZ_MAX_LITERAL 128
+#define LZ_HASH_BITS 8
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+#define CLK_TIMER_COUNT 9
+
+// Registers never take more than this once packed
+#define REGS_MAX_SIZE 96
+
+/*
+    Packed view of the emulator memory, two nibbles per byte
+*/
+
+static inline uint8_t mem_get(const MEM_BUFFER_TYPE *mem, int i)
+{
+#ifdef LOW_FOOTPRINT
+    return mem[i];
+#else
+    return (mem[i * 2] & 0xF) | ((mem[i * 2 + 1] & 0xF) << 4);
+#endif
+}
+
+static inline void mem_set(MEM_BUFFER_TYPE *mem, int i, uint8_t v)
+{
+#ifdef LOW_FOOTPRINT
+    mem[i] = v;
+#else
+    mem[i * 2] = v & 0xF;
+    mem[i * 2 + 1] = v >> 4;
+#endif
+}
+
+/*
+    CRC-32 (zlib polynomial), a nibble at a time from a 16-entry table
+*/
+
+static const uint32_t crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+static inline uint32_t crc_byte(uint32_t crc, uint8_t b)
+{
+    crc = (crc >> 4) ^ crc_table[(crc ^ b) & 0xF];
+    return (crc >> 4) ^ crc_table[(crc ^ (b >> 4)) & 0xF];
+}
+
+/*
+    Buffered output / input. Both keep a running CRC of every byte.
+*/
+
+typedef struct
+{
+    state_write_t write;
+    void *ctx;
+    uint8_t buf[64];
+    size_t used;
+    size_t total;
+    uint32_t crc;
+    bool failed;
+} out_t;
+
+static void out_flush(out_t *out)
+{
+    if (out->used && !out->failed)
+    {
+        out->failed = out->write(out->ctx, out->buf, out->used) != out->used;
+        out->total += out->used;
+    }
+    out->used = 0;
+}
+
+static void out_byte(out_t *out, uint8_t b)
+{
+    out->crc = crc_byte(out->crc, b);
+    out->buf[out->used++] = b;
+    if (out->used == sizeof(out->buf))
+    {
+        out_flush(out);
+    }
+}
+
+typedef struct
+{
+    state_read_t read;
+    void *ctx;
+    uint8_t buf[64];
+    size_t pos;
+    size_t len;
+    uint32_t crc;
+} in_t;
+
+static bool in_byte(in_t *in, uint8_t *b)
+{
+    if (in->pos == in->len)
+    {
+        in->len = in->read(in->ctx, in->buf, sizeof(in->buf));
+        in->pos = 0;
+        if (!in->len)
+        {
+            return false;
+        }
+    }
+    *b = in->buf[in->pos++];
+    in->crc = crc_byte(in->crc, *b);
+    return true;
+}
+
+/*
+    Registers
+*/
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static bool get_varint(in_t *in, uint32_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        uint8_t b;
+        if (!in_byte(in, &b))
+        {
+            return false;
+        }
+        *v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static u32_t *timer_timestamps(state_t *state, int i)
+{
+    u32_t *timers[CLK_TIMER_COUNT] = {
+        state->clk_timer_2hz_timestamp,
+        state->clk_timer_4hz_timestamp,
+        state->clk_timer_8hz_timestamp,
+        state->clk_timer_16hz_timestamp,
+        state->clk_timer_32hz_timestamp,
+        state->clk_timer_64hz_timestamp,
+        state->clk_timer_128hz_timestamp,
+        state->clk_timer_256hz_timestamp,
+        state->prog_timer_timestamp,
+    };
+    return timers[i];
+}
+
+static size_t encode_registers(state_t *state, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    u32_t tick = *state->tick_counter;
+
+    *p++ = *state->pc & 0xFF;
+    *p++ = *state->pc >> 8;
+    *p++ = *state->x & 0xFF;
+    *p++ = ((*state->x >> 8) & 0xF) | ((*state->y & 0xF) << 4);
+    *p++ = *state->y >> 4;
+    *p++ = (*state->a & 0xF) | (*state->b << 4);
+    *p++ = (*state->flags & 0xF) |
+           (*state->prog_timer_enabled ? 0x10 : 0) |
+           (*state->cpu_halted ? 0x20 : 0);
+    *p++ = *state->np;
+    *p++ = *state->sp;
+
+    // Timestamps sit just behind the tick counter, so store the distance
+    p = put_varint(p, tick);
+    for (int i = 0; i < CLK_TIMER_COUNT; i++)
+    {
+        p = put_varint(p, tick - *timer_timestamps(state, i));
+    }
+    *p++ = *state->prog_timer_data;
+    *p++ = *state->prog_timer_rld;
+    p = put_varint(p, *state->call_depth);
+
+    uint8_t triggered = 0;
+    for (int i = 0; i < INT_SLOT_NUM; i++)
+    {
+        triggered |= state->interrupts[i].triggered ? (1 << i) : 0;
+    }
+    *p++ = triggered;
+    for (int i = 0; i < INT_SLOT_NUM; i++)
+    {
+        *p++ = (state->interrupts[i].factor_flag_reg & 0xF) | (state->interrupts[i].mask_reg << 4);
+        *p++ = state->interrupts[i].vector;
+    }
+    return p - buf;
+}
+
+// Decoded registers, committed to the state only once memory decoded too
+typedef struct
+{
+    u13_t pc;
+    u12_t x, y;
+    u4_t a, b, flags;
+    u5_t np;
+    u8_t sp;
+    u32_t tick;
+    u32_t timers[CLK_TIMER_COUNT];
+    bool_t prog_timer_enabled;
+    u8_t prog_timer_data;
+    u8_t prog_timer_rld;
+    u32_t call_depth;
+    interrupt_t interrupts[INT_SLOT_NUM];
+    bool_t cpu_halted;
+} regs_t;
+
+static bool decode_registers(in_t *in, regs_t *r)
+{
+    uint8_t b[9];
+    for (int i = 0; i < 9; i++)
+    {
+        if (!in_byte(in, &b[i]))
+        {
+            return false;
+        }
+    }
+    r->pc = (b[0] | (b[1] << 8)) & 0x1FFF;
+    r->x = b[2] | ((b[3] & 0xF) << 8);
+    r->y = (b[3] >> 4) | (b[4] << 4);
+    r->a = b[5] & 0xF;
+    r->b = b[5] >> 4;
+    r->flags = b[6] & 0xF;
+    r->prog_timer_enabled = (b[6] & 0x10) ? 1 : 0;
+    r->cpu_halted = (b[6] & 0x20) ? 1 : 0;
+    r->np = b[7];
+    r->sp = b[8]; // Any 8-bit SP addresses the stack inside RAM
+
+    // NP is 5 bits and never encoded wider, so more means a corrupt blob
+    if (r->np > 0x1F)
+    {
+        return false;
+    }
+
+    if (!get_varint(in, &r->tick))
+    {
+        return false;
+    }
+    for (int i = 0; i < CLK_TIMER_COUNT; i++)
+    {
+        uint32_t dist;
+        if (!get_varint(in, &dist))
+        {
+            return false;
+        }
+        r->timers[i] = r->tick - dist;
+    }
+
+    uint8_t triggered;
+    if (!in_byte(in, &r->prog_timer_data) ||
+        !in_byte(in, &r->prog_timer_rld) ||
+        !get_varint(in, &r->call_depth) ||
+        !in_byte(in, &triggered))
+    {
+        return false;
+    }
+    for (int i = 0; i < INT_SLOT_NUM; i++)
+    {
+        uint8_t regs, vector;
+        if (!in_byte(in, &regs) || !in_byte(in, &vector))
+        {
+            return false;
+        }
+        r->interrupts[i].factor_flag_reg = regs & 0xF;
+        r->interrupts[i].mask_reg = regs >> 4;
+        r->interrupts[i].triggered = (triggered >> i) & 1;
+        r->interrupts[i].vector = vector;
+    }
+    return true;
+}
+
+static void commit_registers(state_t *state, const regs_t *r)
+{
+    *state->pc = r->pc;
+    *state->x = r->x;
+    *state->y = r->y;
+    *state->a = r->a;
+    *state->b = r->b;
+    *state->flags = r->flags;
+    *state->np = r->np;
+    *state->sp = r->sp;
+    *state->tick_counter = r->tick;
+    for (int i = 0; i < CLK_TIMER_COUNT; i++)
+    {
+        *timer_timestamps(state, i) = r->timers[i];
+    }
+    *state->prog_timer_enabled = r->prog_timer_enabled;
+    *state->prog_timer_data = r->prog_timer_data;
+    *state->prog_timer_rld = r->prog_timer_rld;
+    *state->call_depth = r->call_depth;
+    memcpy(state->interrupts, r->interrupts, sizeof(r->interrupts));
+    *state->cpu_halted = r->cpu_halted;
+}
+
+/*
+    Memory
+*/
+
+static inline uint32_t lz_hash(uint8_t a, uint8_t b, uint8_t c)
+{
+    return ((a << 16 | b << 8 | c) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void lz_literals(out_t *out, const MEM_BUFFER_TYPE *mem, int start, int end)
+{
+    while (start < end)
+    {
+        int run = end - start > LZ_MAX_LITERAL ? LZ_MAX_LITERAL : end - start;
+        out_byte(out, run - 1);
+        for (int i = 0; i < run; i++)
+        {
+            out_byte(out, mem_get(mem, start + i));
+        }
+        start += run;
+    }
+}
+
+static void lz_encode(out_t *out, const MEM_BUFFER_TYPE *mem)
+{
+    uint16_t head[LZ_HASH_SIZE] = {0}; // Last position + 1 for each hash
+    const int n = STATE_PACKED_SIZE;
+    int lit_start = 0;
+    int i = 0;
+
+    while (i < n)
+    {
+        int best_len = 0;
+        int best_off = 0;
+
+        if (i + LZ_MIN_MATCH <= n)
+        {
+            uint32_t h = lz_hash(mem_get(mem, i), mem_get(mem, i + 1), mem_get(mem, i + 2));
+            int cand = head[h] - 1;
+            head[h] = i + 1;
+
+            if (cand >= 0)
+            {
+                int len = 0;
+                while (len < LZ_MAX_MATCH && i + len < n &&
+                       mem_get(mem, cand + len) == mem_get(mem, i + len))
+                {
+                    len++;
+                }
+                if (len >= LZ_MIN_MATCH)
+                {
+                    best_len = len;
+                    best_off = i - cand;
+                }
+            }
+        }
+
+        if (!best_len)
+        {
+            i++;
+            continue;
+        }
+
+        lz_literals(out, mem, lit_start, i);
+        out_byte(out, 0x80 | (best_len - LZ_MIN_MATCH));
+        out_byte(out, best_off & 0xFF);
+        out_byte(out, best_off >> 8);
+
+        // Index the positions inside the match so later data can refer to them
+        for (int k = i + 1; k < i + best_len && k + LZ_MIN_MATCH <= n; k++)
+        {
+            head[lz_hash(mem_get(mem, k), mem_get(mem, k + 1), mem_get(mem, k + 2))] = k + 1;
+        }
+        i += best_len;
+        lit_start = i;
+    }
+    lz_literals(out, mem, lit_start, n);
+}
+
+// With mem NULL only the stream structure is checked
+static bool lz_decode(in_t *in, MEM_BUFFER_TYPE *mem)
+{
+    const int n = STATE_PACKED_SIZE;
+    int o = 0;
+
+    while (o < n)
+    {
+        uint8_t c;
+        if (!in_byte(in, &c))
+        {
+            return false;
+        }
+
+        if (c < 0x80)
+        {
+            if (o + c + 1 > n)
+            {
+                return false;
+            }
+            for (int i = 0; i <= c; i++)
+            {
+                uint8_t b;
+                if (!in_byte(in, &b))
+                {
+                    return false;
+                }
+                if (mem)
+                {
+                    mem_set(mem, o, b);
+                }
+                o++;
+            }
+        }
+        else
+        {
+            uint8_t lo, hi;
+            if (!in_byte(in, &lo) || !in_byte(in, &hi))
+            {
+                return false;
+            }
+            int off = lo | (hi << 8);
+            int len = (c & 0x7F) + LZ_MIN_MATCH;
+            if (off == 0 || off > o || o + len > n)
+            {
+                return false;
+            }
+            // Byte by byte, so overlapping matches repeat correctly
+            for (int i = 0; mem && i < len; i++)
+            {
+                mem_set(mem, o + i, mem_get(mem, o + i - off));
+            }
+            o += len;
+        }
+    }
+    return true;
+}
+
+/*
+    Public API
+*/
+
+size_t state_encode(state_t *state, state_write_t write, void *ctx)
+{
+    out_t out;
+    out.write = write;
+    out.ctx = ctx;
+    out.used = 0;
+    out.total = 0;
+    out.crc = 0xFFFFFFFF;
+    out.failed = false;
+
+    uint8_t regs[REGS_MAX_SIZE];
+    size_t regs_size = encode_registers(state, regs);
+
+    for (int i = 0; i < STATE_CODEC_MAGIC_SIZE; i++)
+    {
+        out_byte(&out, STATE_CODEC_MAGIC[i]);
+    }
+    for (size_t i = 0; i < regs_size; i++)
+    {
+        out_byte(&out, regs[i]);
+    }
+    lz_encode(&out, state->memory);
+
+    uint32_t crc = ~out.crc;
+    for (int i = 0; i < 4; i++)
+    {
+        out_byte(&out, crc >> (i * 8));
+    }
+    out_flush(&out);
+
+    return out.failed ? 0 : out.total;
+}
+
+static bool decode(state_t *state, state_read_t read, void *ctx)
+{
+    in_t in;
+    in.read = read;
+    in.ctx = ctx;
+    in.pos = 0;
+    in.len = 0;
+    in.crc = 0xFFFFFFFF;
+
+    uint8_t magic[STATE_CODEC_MAGIC_SIZE];
+    for (int i = 0; i < STATE_CODEC_MAGIC_SIZE; i++)
+    {
+        if (!in_byte(&in, &magic[i]))
+        {
+            return false;
+        }
+    }
+    bool has_crc = !memcmp(magic, STATE_CODEC_MAGIC, STATE_CODEC_MAGIC_SIZE);
+    if (!has_crc && memcmp(magic, STATE_CODEC_MAGIC_V1, STATE_CODEC_MAGIC_SIZE))
+    {
+        return false;
+    }
+
+    regs_t regs;
+    if (!decode_registers(&in, &regs) || !lz_decode(&in, state ? state->memory : NULL))
+    {
+        return false;
+    }
+
+    if (has_crc)
+    {
+        uint32_t expected = ~in.crc;
+        uint32_t crc = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            uint8_t b;
+            if (!in_byte(&in, &b))
+            {
+                return false;
+            }
+            crc |= (uint32_t)b << (i * 8);
+        }
+        if (crc != expected)
+        {
+            return false;
+        }
+    }
+    if (state)
+    {
+        commit_registers(state, &regs);
+    }
+    return true;
+}
+
+bool state_decode(state_t *state, state_read_t read, void *ctx)
+{
+    return decode(state, read, ctx);
+}
+
+bool state_check(state_read_t read, void *ctx)
+{
+    return decode(NULL, read, ctx);
+}
+
+bool state_is_encoded(const uint8_t *data, size_t len)
+{
+    return len >= STATE_CODEC_MAGIC_SIZE &&
+           (!memcmp(data, STATE_CODEC_MAGIC, STATE_CODEC_MAGIC_SIZE) ||
+            !memcmp(data, STATE_CODEC_MAGIC_V1, STATE_CODEC_MAGIC_SIZE));
+}
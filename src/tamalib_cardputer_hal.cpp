@@ -7,7 +7,18 @@
 #include <M5Cardputer.h>
 #include <SPI.h>
 #include <SD.h>
+#include <esp_rom_crc.h>
+#include "arena.h"
 #include "bitmaps.h"
+#include "capture.h"
+#include "hal_dispatch.h"
+#include "latency.h"
+#include "lcd_blit.h"
+#include "perf.h"
+#include "pet_stats.h"
+#include "power.h"
+#include "save_slots.h"
+#include "state_codec.h"
 
 // SD Card SPI pins for M5Stack Cardputer
 #define SD_SPI_SCK_PIN 40
@@ -15,16 +26,39 @@
 #define SD_SPI_MOSI_PIN 14
 #define SD_SPI_CS_PIN 12
 
-#define ROM_SIZE 12288 // Expected size of tama.b (12KB)
+#define STATE_FILE_MAX (MEM_BUFFER_SIZE + 512)
+
+// Size of a save written before the compact encoding, every field of
+// state_t at its full width
+#define RAW_STATE_SIZE (sizeof(u13_t) + 2 * sizeof(u12_t) + 2 * sizeof(u4_t) + \
+                        sizeof(u5_t) + sizeof(u8_t) + sizeof(u4_t) +           \
+                        10 * sizeof(u32_t) + sizeof(bool_t) + 2 * sizeof(u8_t) + \
+                        sizeof(u32_t) +                                         \
+                        INT_SLOT_NUM * (2 * sizeof(u4_t) + sizeof(bool_t) + sizeof(u8_t)) + \
+                        sizeof(bool_t) + MEM_BUFFER_SIZE)
 
 // External variables from main.cpp
-extern String ROM_STATE;
 extern String ROM_FILE;
 
-// LCD matrix buffer
-static bool_t lcd_matrix[LCD_HEIGHT][LCD_WIDTH];
+uint32_t rom_crc = 0;
+
+// LCD matrix buffer, 1bpp with rows packed MSB first
+static uint8_t lcd_matrix[LCD_HEIGHT][LCD_WIDTH / 8] = {{0}};
 static bool_t icon_buffer[ICON_NUM] = {0};
-static bool_t matrix_buffer[LCD_HEIGHT][LCD_WIDTH / 8] = {{0}};
+
+// Blitters for the LCD matrix and the 16x9 icons. Colors are byte-swapped
+// to the panel's order so the line buffer can be pushed as is.
+#define ICON_SCALE 2
+static lcd_blit_t matrix_blit;
+static lcd_blit_t icon_blit;
+static bool blit_ready = false;
+alignas(4) static uint16_t blit_buffer[LCD_WIDTH * TAMA_PIXEL_SIZE * TAMA_PIXEL_SIZE];
+
+// Set when something else was drawn over the game screen
+static bool screen_clear_pending = true;
+
+// Set when tamalib changed a pixel or icon since the last redraw
+static bool frame_dirty = true;
 
 // LCD icons buffer
 static bool_t lcd_icons[ICON_COUNT];
@@ -36,9 +70,74 @@ static bool_t button_right = 0;
 static bool_t button_save = 0;
 static bool_t button_pause = 0;
 static bool_t button_help = 0;
+static bool_t button_slots = 0;
+static bool_t button_capture = 0;
+static bool_t button_record = 0;
+
+// Buzzer pitch set by tamalib, in Hz
+static uint32_t buzzer_hz = 4096;
+
+// Emulation clock in us. Lag left by blocking screens (pause, help,
+// saving) is dropped instead of being replayed at full speed.
+#define CLOCK_MAX_LAG_US 250000
+static uint32_t clock_offset = 0;
+
+// Shortest wait worth sleeping for, one FreeRTOS tick
+#define SLEEP_MIN_US (portTICK_PERIOD_MS * 1000)
+
+// The keyboard scan costs more than an emulated instruction, so input is
+// polled at a fixed rate rather than on every step
+#define INPUT_POLL_US 5000
 
 // static cpu_state_t cpuState;
 
+// Number of sd_mount() calls not yet matched by sd_unmount(), so a long
+// running user (e.g. a capture to SD) keeps the card mounted
+static uint8_t sd_users = 0;
+
+// Mount the SD card on the Cardputer's SPI pins
+bool sd_mount()
+{
+    if (sd_users)
+    {
+        sd_users++;
+        return true;
+    }
+
+    SPI.begin(SD_SPI_SCK_PIN, SD_SPI_MISO_PIN, SD_SPI_MOSI_PIN, SD_SPI_CS_PIN);
+    if (!SD.begin(SD_SPI_CS_PIN, SPI, 25000000))
+    {
+        return false;
+    }
+    sd_users = 1;
+    return true;
+}
+
+void sd_unmount()
+{
+    if (sd_users && --sd_users == 0)
+    {
+        SD.end();
+    }
+}
+
+// Copy the current LCD matrix as a 1bpp thumbnail (rows MSB first)
+void lcd_thumbnail(uint8_t *thumb)
+{
+    memcpy(thumb, lcd_matrix, SLOT_THUMB_SIZE);
+}
+
+// Clear the whole screen on the next update, after a menu or message
+void display_invalidate()
+{
+    screen_clear_pending = true;
+}
+
+static uint16_t panel_color(uint16_t color)
+{
+    return (color >> 8) | (color << 8);
+}
+
 void draw_triangle(uint16_t x, uint16_t y)
 {
     // Draw a simple downward pointing triangle for icon selection
@@ -47,44 +146,45 @@ void draw_triangle(uint16_t x, uint16_t y)
 
 void draw_icon_bitmap(uint16_t x, uint16_t y, const uint8_t *bitmap)
 {
-    // Draw 16x9 icon bitmap
-    for (int by = 0; by < 9; by++)
-    {
-        for (int bx = 0; bx < 16; bx++)
-        {
-            uint8_t byte_idx = (by * 2) + (bx / 8);
-            uint8_t bit_idx = 7 - (bx % 8);
-            if (bitmap[byte_idx] & (1 << bit_idx))
-            {
-                M5Cardputer.Display.fillRect(x + bx * 2, y + by * 2, 2, 2, TFT_WHITE);
-            }
-        }
-    }
+    // Draw 16x9 icon bitmap (2 bytes per row, MSB first) at 2x scale
+    lcd_blit_rows(&icon_blit, bitmap, 9, blit_buffer);
+    M5Cardputer.Display.pushImage(x, y, 16 * ICON_SCALE, 9 * ICON_SCALE,
+                                  (const lgfx::swap565_t *)blit_buffer);
 }
 
 void update_display()
 {
-    M5Cardputer.Display.fillScreen(TFT_BLACK);
+    if (!blit_ready)
+    {
+        lcd_blit_init(&matrix_blit, LCD_WIDTH, TAMA_PIXEL_SIZE, panel_color(TFT_WHITE), panel_color(TFT_BLACK));
+        lcd_blit_init(&icon_blit, 16, ICON_SCALE, panel_color(TFT_WHITE), panel_color(TFT_BLACK));
+        blit_ready = true;
+    }
+
+    if (screen_clear_pending)
+    {
+        M5Cardputer.Display.fillScreen(TFT_BLACK);
+        screen_clear_pending = false;
+        pet_stats_invalidate();
+    }
+
     // Calculate centering offsets
     uint16_t displayStartX = 20;
     uint16_t displayStartY = 10;
 
-    // Draw the Tamagotchi LCD matrix (32x16 pixels, scaled up)
+    M5Cardputer.Display.startWrite();
+
+    // Draw the Tamagotchi LCD matrix (32x16 pixels, scaled up), one
+    // TAMA_PIXEL_SIZE tall band per source row
     for (uint8_t y = 0; y < LCD_HEIGHT; y++)
     {
-        for (uint8_t x = 0; x < LCD_WIDTH; x++)
-        {
-            if (lcd_matrix[y][x])
-            {
-                // Draw pixel scaled up by TAMA_PIXEL_SIZE
-                M5Cardputer.Display.fillRect(
-                    displayStartX + x * TAMA_PIXEL_SIZE,
-                    displayStartY + y * TAMA_PIXEL_SIZE,
-                    TAMA_PIXEL_SIZE,
-                    TAMA_PIXEL_SIZE,
-                    TFT_WHITE);
-            }
-        }
+        lcd_blit_rows(&matrix_blit, lcd_matrix[y], 1, blit_buffer);
+        M5Cardputer.Display.pushImage(
+            displayStartX,
+            displayStartY + y * TAMA_PIXEL_SIZE,
+            LCD_WIDTH * TAMA_PIXEL_SIZE,
+            TAMA_PIXEL_SIZE,
+            (const lgfx::swap565_t *)blit_buffer);
     }
 
     // Draw icon selection row at the bottom
@@ -94,6 +194,7 @@ void update_display()
         uint16_t iconX = displayStartX + i * 28;
 
         // Draw selection triangle if icon is selected
+        M5Cardputer.Display.fillRect(iconX + 6, iconY, 7, 4, TFT_BLACK);
         if (lcd_icons[i])
         {
             draw_triangle(iconX + 6, iconY);
@@ -102,10 +203,19 @@ void update_display()
         // Draw the icon bitmap
         draw_icon_bitmap(iconX, iconY + 8, bitmaps + i * 18);
     }
+
+    M5Cardputer.Display.endWrite();
+}
+
+// Sink for state_encode()
+static size_t state_file_write(void *ctx, const uint8_t *data, size_t len)
+{
+    return ((File *)ctx)->write(data, len);
 }
 
 void save_state()
 {
+    display_invalidate();
     M5Cardputer.Display.fillScreen(TFT_DARKGREEN);
     M5Cardputer.Display.setTextSize(2);
     M5Cardputer.Display.setCursor(5, 60);
@@ -121,8 +231,7 @@ void save_state()
     }
 
     // Initialize SD card
-    SPI.begin(SD_SPI_SCK_PIN, SD_SPI_MISO_PIN, SD_SPI_MOSI_PIN, SD_SPI_CS_PIN);
-    if (!SD.begin(SD_SPI_CS_PIN, SPI, 25000000))
+    if (!sd_mount())
     {
         M5Cardputer.Display.println("SD init failed!");
         delay(1500);
@@ -130,157 +239,112 @@ void save_state()
     }
 
     // Delete old state file if it exists
-    if (SD.exists(ROM_STATE.c_str()))
+    slot_dir_create();
+    String statePath = slot_state_path(active_slot);
+    if (SD.exists(statePath.c_str()))
     {
-        SD.remove(ROM_STATE.c_str());
+        SD.remove(statePath.c_str());
     }
 
     // Open file for writing
-    File stateFile = SD.open(ROM_STATE.c_str(), FILE_WRITE);
+    File stateFile = SD.open(statePath.c_str(), FILE_WRITE);
     if (!stateFile)
     {
         M5Cardputer.Display.println("File open failed!");
-        SD.end();
+        sd_unmount();
         delay(1500);
         return;
     }
 
-    // Write state to file
-    // Write CPU registers
-    stateFile.write((uint8_t *)state->pc, sizeof(u13_t));
-    stateFile.write((uint8_t *)state->x, sizeof(u12_t));
-    stateFile.write((uint8_t *)state->y, sizeof(u12_t));
-    stateFile.write((uint8_t *)state->a, sizeof(u4_t));
-    stateFile.write((uint8_t *)state->b, sizeof(u4_t));
-    stateFile.write((uint8_t *)state->np, sizeof(u5_t));
-    stateFile.write((uint8_t *)state->sp, sizeof(u8_t));
-    stateFile.write((uint8_t *)state->flags, sizeof(u4_t));
-
-    // Write timers
-    stateFile.write((uint8_t *)state->tick_counter, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->clk_timer_2hz_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->clk_timer_4hz_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->clk_timer_8hz_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->clk_timer_16hz_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->clk_timer_32hz_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->clk_timer_64hz_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->clk_timer_128hz_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->clk_timer_256hz_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->prog_timer_timestamp, sizeof(u32_t));
-    stateFile.write((uint8_t *)state->prog_timer_enabled, sizeof(bool_t));
-    stateFile.write((uint8_t *)state->prog_timer_data, sizeof(u8_t));
-    stateFile.write((uint8_t *)state->prog_timer_rld, sizeof(u8_t));
-
-    stateFile.write((uint8_t *)state->call_depth, sizeof(u32_t));
-
-    // Write interrupts (array of INT_SLOT_NUM interrupts)
-    for (int i = 0; i < INT_SLOT_NUM; i++)
+    // Write the packed, compressed state
+    size_t stateSize = state_encode(state, state_file_write, &stateFile);
+    stateFile.close();
+    if (!stateSize)
     {
-        stateFile.write((uint8_t *)&state->interrupts[i].factor_flag_reg, sizeof(u4_t));
-        stateFile.write((uint8_t *)&state->interrupts[i].mask_reg, sizeof(u4_t));
-        stateFile.write((uint8_t *)&state->interrupts[i].triggered, sizeof(bool_t));
-        stateFile.write((uint8_t *)&state->interrupts[i].vector, sizeof(u8_t));
+        M5Cardputer.Display.println("Write failed!");
+        sd_unmount();
+        delay(1500);
+        return;
     }
 
-    stateFile.write((uint8_t *)state->cpu_halted, sizeof(bool_t));
-
-    // Write memory (most important!)
-    stateFile.write((uint8_t *)state->memory, MEM_BUFFER_SIZE);
-
-    stateFile.close();
-    SD.end();
+    // Update only this slot's record in the index
+    slot_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.used = 1;
+    info.timestamp = (uint32_t)time(NULL);
+    info.rom_hash = rom_crc;
+    info.play_time = slot_play_time();
+    lcd_thumbnail(info.thumb);
+    if (!slot_index_update(active_slot, &info))
+    {
+        USBSerial.println("[!] Slot index update failed");
+    }
+    sd_unmount();
 
     M5Cardputer.Display.println("Saved successfully!");
-    USBSerial.println("[*] State saved to SD card");
+    USBSerial.printf("[*] State saved to slot %d (%u bytes)\n", active_slot + 1, (unsigned)stateSize);
     delay(1500);
 }
 
-// Convert ROM from 4-byte format to 3-byte packed format
-// Input: rom_data (12288 bytes), Output: packed_rom (9216 bytes)
-void convert_rom_to_12bit(const uint8_t *rom_data, uint8_t *packed_rom)
+// Read and decode the ROM (SD must be mounted). Returns NULL on failure.
+u12_t *load_rom()
 {
-    for (int i = 0; i < (ROM_SIZE / 4); i++)
-    {
-        uint8_t v1 = rom_data[i * 4];
-        uint8_t v2 = rom_data[i * 4 + 1];
-        uint8_t v3 = rom_data[i * 4 + 2];
-        uint8_t v4 = rom_data[i * 4 + 3];
+    USBSerial.print("[*] Loading rom ... ");
 
-        packed_rom[i * 3] = (v1 << 4) | ((v2 >> 4) & 0xF);
-        packed_rom[i * 3 + 1] = ((v2 & 0xF) << 4) | v3;
-        packed_rom[i * 3 + 2] = v4;
-    }
-}
-
-// Unpack 3-byte packed format to u12_t array
-void unpack_rom_to_12bit_array(const uint8_t *packed_rom, int packed_size, u12_t *rom_data)
-{
-    int rom_word_count = (packed_size * 2) / 3;
-    for (int i = 0; i < rom_word_count; i += 2)
+    // The ROM file holds one big-endian 16-bit word per 12-bit opcode, so
+    // it is read straight into the array handed to tamalib and decoded in
+    // place
+    u12_t *rom_data = (u12_t *)arena_try_malloc(ROM_SIZE);
+    if (!rom_data)
     {
-        int byte_idx = (i * 3) / 2;
-        uint8_t b0 = packed_rom[byte_idx];
-        uint8_t b1 = packed_rom[byte_idx + 1];
-        uint8_t b2 = packed_rom[byte_idx + 2];
-
-        rom_data[i] = (b0 << 4) | ((b1 >> 4) & 0x0F);
-        rom_data[i + 1] = ((b1 & 0x0F) << 8) | b2;
+        USBSerial.println("Failed, out of memory");
+        return NULL;
     }
-}
-
-u12_t *load_rom()
-{
-    // Initialize SD card with correct SPI pins
-    USBSerial.print("[*] Initializing SD and Loading rom ... ");
-    uint8_t *raw_rom = (uint8_t *)malloc(ROM_SIZE);
+    uint8_t *raw_rom = (uint8_t *)rom_data;
     bool rom_loaded = false;
 
-    SPI.begin(SD_SPI_SCK_PIN, SD_SPI_MISO_PIN, SD_SPI_MOSI_PIN, SD_SPI_CS_PIN);
-
-    if (SD.begin(SD_SPI_CS_PIN, SPI, 25000000))
+    File romFile = SD.open(ROM_FILE.c_str(), FILE_READ);
+    if (romFile)
     {
-        File romFile = SD.open(ROM_FILE.c_str(), FILE_READ);
-        if (romFile)
+        size_t size = romFile.size();
+        if (size == ROM_SIZE && romFile.read(raw_rom, ROM_SIZE) == ROM_SIZE)
         {
-            size_t size = romFile.size();
-            if (size == ROM_SIZE)
-            {
-                romFile.read(raw_rom, ROM_SIZE);
-                rom_loaded = true;
-            }
-            romFile.close();
+            rom_crc = esp_rom_crc32_le(0, raw_rom, ROM_SIZE);
+            rom_loaded = true;
         }
-        SD.end();
+        romFile.close();
     }
-    USBSerial.println("Done");
 
     if (!rom_loaded)
     {
-        M5Cardputer.Display.fillScreen(TFT_RED);
-        M5Cardputer.Display.setCursor(10, 50);
-        M5Cardputer.Display.println("ERROR:");
-        M5Cardputer.Display.setCursor(10, 70);
-        M5Cardputer.Display.printf("%s not found!\n", ROM_FILE.c_str());
-        free(raw_rom);
-        while (1)
-            delay(1000);
-    }
-
-    // Convert ROM from 4-byte to 3-byte packed format
-    const int packed_size = (ROM_SIZE / 4) * 3; // 9216 bytes
-    uint8_t *packed_rom = (uint8_t *)malloc(packed_size);
-    convert_rom_to_12bit(raw_rom, packed_rom);
-    free(raw_rom); // Don't need the raw ROM anymore
-
-    // Unpack to u12_t array for tamalib
-    const int rom_word_count = (packed_size * 2) / 3;
-    u12_t *rom_data = (u12_t *)malloc(sizeof(u12_t) * rom_word_count);
-    unpack_rom_to_12bit_array(packed_rom, packed_size, rom_data);
-    free(packed_rom); // Don't need packed ROM anymore
+        USBSerial.println("Failed");
+        arena_free(rom_data);
+        return NULL;
+    }
+
+    for (int i = 0; i < ROM_SIZE / 2; i++)
+    {
+        rom_data[i] = ((raw_rom[i * 2] << 8) | raw_rom[i * 2 + 1]) & 0xFFF;
+    }
     USBSerial.println("Done.");
     return rom_data;
 }
 
+void rom_error()
+{
+    M5Cardputer.Display.fillScreen(TFT_RED);
+    M5Cardputer.Display.setTextSize(2);
+    M5Cardputer.Display.setTextColor(TFT_WHITE);
+    M5Cardputer.Display.setCursor(10, 50);
+    M5Cardputer.Display.println("ERROR: No ROM!");
+    M5Cardputer.Display.setCursor(10, 70);
+    M5Cardputer.Display.println("Copy ROMs to");
+    M5Cardputer.Display.setCursor(10, 90);
+    M5Cardputer.Display.println("/tamaputer/roms/");
+    while (1)
+        delay(1000);
+}
+
 void pause_game()
 {
     static uint8_t volume = 32; // Store volume between pauses
@@ -367,12 +431,13 @@ void pause_game()
         delay(10);
     }
 
+    display_invalidate();
     update_display();
 }
 
 void draw_help_screen()
 {
-    M5Cardputer.Display.setCursor(0, 10);
+    M5Cardputer.Display.setCursor(0, 0);
     M5Cardputer.Display.fillScreen(TFT_BLACK);
     M5Cardputer.Display.setTextSize(2);
     M5Cardputer.Display.setTextColor(TFT_GREEN);
@@ -385,6 +450,7 @@ void draw_help_screen()
     M5Cardputer.Display.println("Menu");
     M5Cardputer.Display.println("  P : Pause");
     M5Cardputer.Display.println("  Z : Save");
+    M5Cardputer.Display.println("  S : Slots");
 }
 
 void display_help()
@@ -401,100 +467,245 @@ void display_help()
         M5Cardputer.update();
         delay(100);
     }
+    display_invalidate();
 }
 
-bool_t load_from_state()
+// Read a slot's state file into memory (SD must be mounted) so it can be
+// applied once tamalib is initialized
+bool read_state_file(uint8_t slot, state_file_t *file)
 {
-    USBSerial.println("[*] Checking for saved state...");
+    memset(file, 0, sizeof(state_file_t));
+    file->slot = slot;
 
-    // Initialize SD card
-    SPI.begin(SD_SPI_SCK_PIN, SD_SPI_MISO_PIN, SD_SPI_MOSI_PIN, SD_SPI_CS_PIN);
-    if (!SD.begin(SD_SPI_CS_PIN, SPI, 25000000))
+    // The index holds the slot's play time
+    slot_info_t slots[SAVE_SLOT_COUNT];
+    slot_index_read(slots);
+    file->play_time = slots[slot].used ? slots[slot].play_time : 0;
+
+    // Slots are kept per ROM, but a copied-in index could still disagree
+    if (slots[slot].used && slots[slot].rom_hash != rom_crc)
     {
-        USBSerial.println("[!] SD init failed for state load");
-        return 0;
+        USBSerial.printf("[!] Slot %d was saved with another ROM, not loading\n", slot + 1);
+        return false;
     }
 
+    String statePath = slot_state_path(slot);
+
     // Check if state file exists
-    if (!SD.exists(ROM_STATE.c_str()))
+    if (!SD.exists(statePath.c_str()))
     {
         USBSerial.println("[*] No saved state found, starting fresh");
-        SD.end();
-        return 0;
+        return false;
     }
 
     // Open file for reading
-    File stateFile = SD.open(ROM_STATE.c_str(), FILE_READ);
+    File stateFile = SD.open(statePath.c_str(), FILE_READ);
     if (!stateFile)
     {
         USBSerial.println("[!] State file open failed!");
-        SD.end();
-        return 0;
+        return false;
     }
 
-    // Get current CPU state (we'll write into these pointers)
-    state_t *state = tamalib_get_state();
-    if (!state)
+    // Raw saves from older firmware are the largest valid files; anything
+    // bigger is not a state and must not exhaust the arena
+    file->size = stateFile.size();
+    if (file->size > STATE_FILE_MAX)
     {
-        USBSerial.println("[!] Error: No state!");
+        USBSerial.println("[!] State file too large!");
         stateFile.close();
-        SD.end();
-        return 0;
+        file->size = 0;
+        return false;
+    }
+
+    file->data = (uint8_t *)arena_try_malloc(file->size);
+    if (!file->data)
+    {
+        USBSerial.println("[!] Not enough memory for the state file!");
+        stateFile.close();
+        file->size = 0;
+        return false;
+    }
+    if (stateFile.read(file->data, file->size) != file->size)
+    {
+        USBSerial.println("[!] State file read failed!");
+        stateFile.close();
+        free_state_file(file);
+        return false;
+    }
+    stateFile.close();
+    return true;
+}
+
+void free_state_file(state_file_t *file)
+{
+    arena_free(file->data);
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Copy the next field out of a state file buffer
+static bool state_read(const uint8_t **pos, const uint8_t *end, void *dst, size_t size)
+{
+    if (*pos + size > end)
+    {
+        return false;
+    }
+    memcpy(dst, *pos, size);
+    *pos += size;
+    return true;
+}
+
+// Streams a state file buffer into state_decode()
+typedef struct
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+} state_buffer_t;
+
+static size_t state_buffer_read(void *ctx, uint8_t *data, size_t len)
+{
+    state_buffer_t *buf = (state_buffer_t *)ctx;
+    size_t n = buf->end - buf->pos < (ptrdiff_t)len ? buf->end - buf->pos : len;
+    memcpy(data, buf->pos, n);
+    buf->pos += n;
+    return n;
+}
+
+// Files saved before the compact encoding: every field at its full width.
+// The size is checked first so a short or padded file leaves the game
+// untouched instead of half applied.
+static bool apply_raw_state(state_t *state, const state_file_t *file)
+{
+    if (file->size != RAW_STATE_SIZE)
+    {
+        return false;
     }
 
-    // Read state from file
+    const uint8_t *pos = file->data;
+    const uint8_t *end = file->data + file->size;
+    bool ok = true;
+
     // Read CPU registers
-    stateFile.read((uint8_t *)state->pc, sizeof(u13_t));
-    stateFile.read((uint8_t *)state->x, sizeof(u12_t));
-    stateFile.read((uint8_t *)state->y, sizeof(u12_t));
-    stateFile.read((uint8_t *)state->a, sizeof(u4_t));
-    stateFile.read((uint8_t *)state->b, sizeof(u4_t));
-    stateFile.read((uint8_t *)state->np, sizeof(u5_t));
-    stateFile.read((uint8_t *)state->sp, sizeof(u8_t));
-    stateFile.read((uint8_t *)state->flags, sizeof(u4_t));
+    ok &= state_read(&pos, end, state->pc, sizeof(u13_t));
+    ok &= state_read(&pos, end, state->x, sizeof(u12_t));
+    ok &= state_read(&pos, end, state->y, sizeof(u12_t));
+    ok &= state_read(&pos, end, state->a, sizeof(u4_t));
+    ok &= state_read(&pos, end, state->b, sizeof(u4_t));
+    ok &= state_read(&pos, end, state->np, sizeof(u5_t));
+    ok &= state_read(&pos, end, state->sp, sizeof(u8_t));
+    ok &= state_read(&pos, end, state->flags, sizeof(u4_t));
 
     // Read timers
-    stateFile.read((uint8_t *)state->tick_counter, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->clk_timer_2hz_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->clk_timer_4hz_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->clk_timer_8hz_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->clk_timer_16hz_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->clk_timer_32hz_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->clk_timer_64hz_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->clk_timer_128hz_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->clk_timer_256hz_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->prog_timer_timestamp, sizeof(u32_t));
-    stateFile.read((uint8_t *)state->prog_timer_enabled, sizeof(bool_t));
-    stateFile.read((uint8_t *)state->prog_timer_data, sizeof(u8_t));
-    stateFile.read((uint8_t *)state->prog_timer_rld, sizeof(u8_t));
-
-    stateFile.read((uint8_t *)state->call_depth, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->tick_counter, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->clk_timer_2hz_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->clk_timer_4hz_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->clk_timer_8hz_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->clk_timer_16hz_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->clk_timer_32hz_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->clk_timer_64hz_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->clk_timer_128hz_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->clk_timer_256hz_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->prog_timer_timestamp, sizeof(u32_t));
+    ok &= state_read(&pos, end, state->prog_timer_enabled, sizeof(bool_t));
+    ok &= state_read(&pos, end, state->prog_timer_data, sizeof(u8_t));
+    ok &= state_read(&pos, end, state->prog_timer_rld, sizeof(u8_t));
+
+    ok &= state_read(&pos, end, state->call_depth, sizeof(u32_t));
 
     // Read interrupts (array of INT_SLOT_NUM interrupts)
     for (int i = 0; i < INT_SLOT_NUM; i++)
     {
-        stateFile.read((uint8_t *)&state->interrupts[i].factor_flag_reg, sizeof(u4_t));
-        stateFile.read((uint8_t *)&state->interrupts[i].mask_reg, sizeof(u4_t));
-        stateFile.read((uint8_t *)&state->interrupts[i].triggered, sizeof(bool_t));
-        stateFile.read((uint8_t *)&state->interrupts[i].vector, sizeof(u8_t));
+        ok &= state_read(&pos, end, &state->interrupts[i].factor_flag_reg, sizeof(u4_t));
+        ok &= state_read(&pos, end, &state->interrupts[i].mask_reg, sizeof(u4_t));
+        ok &= state_read(&pos, end, &state->interrupts[i].triggered, sizeof(bool_t));
+        ok &= state_read(&pos, end, &state->interrupts[i].vector, sizeof(u8_t));
     }
 
-    stateFile.read((uint8_t *)state->cpu_halted, sizeof(bool_t));
+    ok &= state_read(&pos, end, state->cpu_halted, sizeof(bool_t));
 
     // Read memory (most important!)
-    stateFile.read((uint8_t *)state->memory, MEM_BUFFER_SIZE);
+    ok &= state_read(&pos, end, state->memory, MEM_BUFFER_SIZE);
 
-    stateFile.close();
-    SD.end();
+    return ok;
+}
+
+// Write a state file read by read_state_file() into the emulator
+bool_t apply_state_file(const state_file_t *file)
+{
+    // Get current CPU state (we'll write into these pointers)
+    state_t *state = tamalib_get_state();
+    if (!state)
+    {
+        USBSerial.println("[!] Error: No state!");
+        return 0;
+    }
+
+    if (state_is_encoded(file->data, file->size))
+    {
+        // Check the whole file first so a bad one leaves the game untouched
+        state_buffer_t check = {file->data, file->data + file->size};
+        state_buffer_t buf = check;
+        if (!state_check(state_buffer_read, &check) ||
+            !state_decode(state, state_buffer_read, &buf))
+        {
+            USBSerial.println("[!] State file corrupt!");
+            return 0;
+        }
+    }
+    else if (!apply_raw_state(state, file))
+    {
+        USBSerial.printf("[!] State file is %u bytes, expected %u!\n",
+                         (unsigned)file->size, (unsigned)RAW_STATE_SIZE);
+        return 0;
+    }
 
     // Refresh hardware state from loaded memory
     tamalib_refresh_hw();
+    active_slot = file->slot;
+    slot_play_time_reset(file->play_time);
 
-    USBSerial.println("[*] State loaded successfully!");
+    USBSerial.printf("[*] State loaded from slot %d\n", active_slot + 1);
     USBSerial.printf("[*] PC: %d, A: %d, B: %d\n", *state->pc, *state->a, *state->b);
     return 1;
 }
 
+// Load the slot that was saved most recently
+bool_t load_from_state()
+{
+    uint8_t last_slot = 0;
+    if (sd_mount())
+    {
+        slot_info_t slots[SAVE_SLOT_COUNT];
+        slot_index_read(slots, &last_slot);
+        sd_unmount();
+    }
+    return load_state_slot(last_slot);
+}
+
+bool_t load_state_slot(uint8_t slot)
+{
+    USBSerial.println("[*] Checking for saved state...");
+
+    // Initialize SD card
+    if (!sd_mount())
+    {
+        USBSerial.println("[!] SD init failed for state load");
+        return 0;
+    }
+
+    state_file_t file;
+    bool found = read_state_file(slot, &file);
+    sd_unmount();
+    if (!found)
+    {
+        return 0;
+    }
+
+    bool_t loaded = apply_state_file(&file);
+    free_state_file(&file);
+    return loaded;
+}
+
 void handle_input()
 {
     M5Cardputer.update();
@@ -509,30 +720,65 @@ void handle_input()
     button_save = M5Cardputer.Keyboard.isKeyPressed(M5_BTN_SAVE);
     button_pause = M5Cardputer.Keyboard.isKeyPressed(M5_BTN_PAUSE);
     button_help = M5Cardputer.Keyboard.isKeyPressed(M5_BTN_HELP);
+    button_slots = M5Cardputer.Keyboard.isKeyPressed(M5_BTN_SLOTS);
+    button_capture = M5Cardputer.Keyboard.isKeyPressed(M5_BTN_CAPTURE);
+    button_record = M5Cardputer.Keyboard.isKeyPressed(M5_BTN_RECORD);
+
+    // A game button press or release starts a latency trace
+    static uint8_t prev_buttons = 0;
+    uint8_t buttons = (button_left ? 1 : 0) | (button_middle ? 2 : 0) | (button_right ? 4 : 0);
+    if (buttons != prev_buttons)
+    {
+        latency_key_edge();
+        prev_buttons = buttons;
+    }
+
+    if (M5Cardputer.Keyboard.isPressed())
+    {
+        power_activity();
+    }
 }
 
 // HAL callback: Called when a pixel needs to be set/cleared
-void hal_set_lcd_matrix(u8_t x, u8_t y, bool_t val)
+TAMA_HOT void hal_set_lcd_matrix(u8_t x, u8_t y, bool_t val)
 {
     if (x < LCD_WIDTH && y < LCD_HEIGHT)
     {
-        lcd_matrix[y][x] = val;
+        uint8_t old = lcd_matrix[y][x / 8];
+        if (val)
+        {
+            lcd_matrix[y][x / 8] |= 0x80 >> (x % 8);
+        }
+        else
+        {
+            lcd_matrix[y][x / 8] &= ~(0x80 >> (x % 8));
+        }
+        if (lcd_matrix[y][x / 8] != old)
+        {
+            frame_dirty = true;
+            latency_lcd_change();
+        }
     }
 }
 
 // HAL callback: Called when an icon needs to be set/cleared
-void hal_set_lcd_icon(u8_t icon, bool_t val)
+TAMA_HOT void hal_set_lcd_icon(u8_t icon, bool_t val)
 {
     if (icon < ICON_COUNT)
     {
+        if (lcd_icons[icon] != val)
+        {
+            frame_dirty = true;
+            latency_lcd_change();
+        }
         lcd_icons[icon] = val;
     }
 }
 
-// HAL callback: Called to set CPU frequency (not used on ESP32)
+// HAL callback: Called to set the buzzer frequency (in dHz)
 void hal_set_frequency(u32_t freq)
 {
-    // Not implemented
+    buzzer_hz = freq / 10;
 }
 
 // HAL callback: Called to enable/disable buzzer
@@ -540,8 +786,9 @@ void hal_play_frequency(bool_t en)
 {
     if (en)
     {
-        // Play a beep tone at 4000 Hz
-        M5Cardputer.Speaker.tone(2000, 50);
+        // Play a short beep at the pitch tamalib selected
+        M5Cardputer.Speaker.tone(buzzer_hz, 50);
+        power_activity();
     }
     else
     {
@@ -562,19 +809,47 @@ void hal_halt(void)
 // HAL callback: Called to update the screen
 void hal_update_screen(void)
 {
-    update_display();
+    // Unchanged frames are not pushed to the panel again
+    bool changed = frame_dirty || screen_clear_pending;
+    if (changed)
+    {
+        update_display();
+        frame_dirty = false;
+    }
+    latency_display_pushed();
+    pet_stats_draw();
+    power_frame(changed);
+    capture_frame(&lcd_matrix[0][0], lcd_icons);
 }
 
-// HAL callback: Get current timestamp in 1/32768 second units
-timestamp_t hal_get_timestamp(void)
+// HAL callback: Get current timestamp in us (the ts_freq given to tamalib)
+TAMA_HOT timestamp_t hal_get_timestamp(void)
 {
-    return millis() * 1000;
+    return micros() - clock_offset;
 }
 
-// HAL callback: Sleep until timestamp
-void hal_sleep_until(timestamp_t ts)
+// HAL callback: Sleep until timestamp, which paces emulation to real time
+// at any CPU clock
+TAMA_HOT void hal_sleep_until(timestamp_t ts)
 {
-    // Not Implemented
+    int32_t remaining = (int32_t)(ts - hal_get_timestamp());
+    if (remaining < -CLOCK_MAX_LAG_US)
+    {
+        clock_offset -= remaining;
+        return;
+    }
+
+    // Instructions are ~150-200 us apart, well under a tick, so waiting
+    // for each one would spin the core all the time. Run ahead instead and
+    // sleep whole ticks once the deadline is at least a tick away:
+    // emulation runs in bursts, the idle task gets the core in between,
+    // and tamalib's deadlines are absolute, so nothing drifts.
+    if (remaining >= (int32_t)SLEEP_MIN_US)
+    {
+        uint32_t ms = remaining / SLEEP_MIN_US * portTICK_PERIOD_MS;
+        perf_wait_us += ms * 1000;
+        delay(ms);
+    }
 }
 
 // HAL callback: Check if logging is enabled for a level
@@ -603,11 +878,22 @@ void hal_log(log_level_t level, char *buff, ...)
 }
 
 // HAL callback: Handle button input
-int hal_handler(void)
+TAMA_HOT int hal_handler(void)
 {
     static bool prev_save = 0;
     static bool prev_pause = 0;
     static bool prev_help = 0;
+    static bool prev_slots = 0;
+    static bool prev_capture = 0;
+    static bool prev_record = 0;
+    static uint32_t last_poll = 0;
+
+    uint32_t now = micros();
+    if (now - last_poll < INPUT_POLL_US)
+    {
+        return 1;
+    }
+    last_poll = now;
 
     handle_input();
 
@@ -630,9 +916,44 @@ int hal_handler(void)
         display_help();
     }
 
+    // Open the slot picker on rising edge
+    if (button_slots && !prev_slots)
+    {
+        slot_picker();
+    }
+    prev_slots = button_slots;
+
+    // Toggle frame streaming over serial / recording to SD on rising edge
+    if (button_capture && !prev_capture)
+    {
+        if (capture_target() == CAPTURE_OFF)
+        {
+            capture_start(CAPTURE_SERIAL);
+        }
+        else
+        {
+            capture_stop();
+        }
+    }
+    prev_capture = button_capture;
+
+    if (button_record && !prev_record)
+    {
+        if (capture_target() == CAPTURE_OFF)
+        {
+            capture_start(CAPTURE_SD);
+        }
+        else
+        {
+            capture_stop();
+        }
+    }
+    prev_record = button_record;
+
     // Set button states using proper enum values
     tamalib_set_button(BTN_LEFT, button_left ? BTN_STATE_PRESSED : BTN_STATE_RELEASED);
     tamalib_set_button(BTN_MIDDLE, button_middle ? BTN_STATE_PRESSED : BTN_STATE_RELEASED);
     tamalib_set_button(BTN_RIGHT, button_right ? BTN_STATE_PRESSED : BTN_STATE_RELEASED);
+    latency_button_set();
     return 1; // Continue running
 }
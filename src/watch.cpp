@@ -0,0 +1,108 @@
+/*
+    RAM watchpoints, see watch.h
+*/
+
+#include "watch.h"
+
+typedef struct
+{
+    bool used;
+    u12_t addr;
+    uint8_t nibbles;
+    uint16_t value;
+    watch_cb_t cb;
+    void *ctx;
+} watch_t;
+
+static watch_t watches[WATCH_MAX];
+uint8_t watch_count = 0;
+
+static inline uint8_t mem_nibble(const MEM_BUFFER_TYPE *mem, u12_t addr)
+{
+#ifdef LOW_FOOTPRINT
+    return (mem[addr >> 1] >> ((addr & 1) * 4)) & 0xF;
+#else
+    return mem[addr] & 0xF;
+#endif
+}
+
+static uint16_t watch_read(const MEM_BUFFER_TYPE *mem, const watch_t *w)
+{
+    uint16_t value = 0;
+    for (int i = 0; i < w->nibbles; i++)
+    {
+        value |= mem_nibble(mem, w->addr + i) << (i * 4);
+    }
+    return value;
+}
+
+int watch_add(u12_t addr, uint8_t nibbles, watch_cb_t cb, void *ctx)
+{
+    state_t *state = tamalib_get_state();
+    if (!state || !cb || nibbles < 1 || nibbles > 4 || addr + nibbles > MEMORY_SIZE)
+    {
+        return WATCH_NONE;
+    }
+
+    for (int id = 0; id < WATCH_MAX; id++)
+    {
+        watch_t *w = &watches[id];
+        if (w->used)
+        {
+            continue;
+        }
+        w->used = true;
+        w->addr = addr;
+        w->nibbles = nibbles;
+        w->cb = cb;
+        w->ctx = ctx;
+        w->value = watch_read(state->memory, w);
+        watch_count++;
+        return id;
+    }
+    return WATCH_NONE;
+}
+
+void watch_remove(int id)
+{
+    if (id >= 0 && id < WATCH_MAX && watches[id].used)
+    {
+        watches[id].used = false;
+        watch_count--;
+    }
+}
+
+void watch_clear()
+{
+    for (int id = 0; id < WATCH_MAX; id++)
+    {
+        watches[id].used = false;
+    }
+    watch_count = 0;
+}
+
+uint16_t watch_value(int id)
+{
+    return (id >= 0 && id < WATCH_MAX && watches[id].used) ? watches[id].value : 0;
+}
+
+void watch_poll_all()
+{
+    const MEM_BUFFER_TYPE *mem = tamalib_get_state()->memory;
+    for (int id = 0; id < WATCH_MAX; id++)
+    {
+        watch_t *w = &watches[id];
+        if (!w->used)
+        {
+            continue;
+        }
+
+        uint16_t value = watch_read(mem, w);
+        if (value != w->value)
+        {
+            uint16_t old = w->value;
+            w->value = value;
+            w->cb(id, value, old, w->ctx);
+        }
+    }
+}
@@ -0,0 +1,114 @@
+/*
+    Host benchmark for the 1bpp to RGB565 blitter (src/lcd_blit.cpp).
+
+    Build and run from the repository root:
+        g++ -O2 -Iinclude src/lcd_blit.cpp tools/blit_bench/blit_bench.cpp -o blit_bench
+        ./blit_bench [scale]
+
+    Every kernel is checked against the scalar one, then timed expanding
+    full 32x16 frames. The SPI line shows how long the same frame takes to
+    push to the Cardputer's display at 40 MHz.
+*/
+
+#include "lcd_blit.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_WIDTH 32
+#define FRAME_HEIGHT 16
+#define SPI_HZ 40000000.0
+
+typedef void (*row_fn_t)(const lcd_blit_t *, const uint8_t *, uint16_t *);
+
+static uint8_t frame[FRAME_HEIGHT][FRAME_WIDTH / 8];
+static uint16_t out[LCD_BLIT_MAX_OUT];
+static uint16_t ref[LCD_BLIT_MAX_OUT];
+
+static bool check(const lcd_blit_t *blit, row_fn_t fn, const char *name)
+{
+    int out_width = blit->width * blit->scale;
+    for (int y = 0; y < FRAME_HEIGHT; y++)
+    {
+        lcd_blit_row_scalar(blit, frame[y], ref);
+        fn(blit, frame[y], out);
+        if (memcmp(ref, out, out_width * sizeof(uint16_t)))
+        {
+            printf("%-8s MISMATCH on row %d\n", name, y);
+            return false;
+        }
+    }
+    return true;
+}
+
+static double bench(const lcd_blit_t *blit, row_fn_t fn, const char *name)
+{
+    const int iterations = 200000;
+    int out_width = blit->width * blit->scale;
+    volatile uint16_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (int y = 0; y < FRAME_HEIGHT; y++)
+        {
+            fn(blit, frame[y], out);
+        }
+        sink = sink + out[i % out_width];
+        frame[i % FRAME_HEIGHT][0] ^= 0x10;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Rows are expanded once and the copies for the scaled rows are memcpy,
+    // so count the pixels the kernel actually produced
+    double pixels = (double)iterations * FRAME_HEIGHT * out_width;
+    double frame_us = secs * 1e6 / iterations;
+    printf("%-8s %10.1f Mpx/s  %8.3f us/frame\n", name, pixels / secs / 1e6, frame_us);
+    return frame_us;
+}
+
+int main(int argc, char **argv)
+{
+    int scale = argc > 1 ? atoi(argv[1]) : 5;
+
+    lcd_blit_t blit;
+    if (!lcd_blit_init(&blit, FRAME_WIDTH, scale, 0xFFFF, 0x0000))
+    {
+        printf("Invalid scale %d (1..%d)\n", scale, LCD_BLIT_MAX_SCALE);
+        return 1;
+    }
+
+    srand(1);
+    for (int y = 0; y < FRAME_HEIGHT; y++)
+    {
+        for (int x = 0; x < FRAME_WIDTH / 8; x++)
+        {
+            frame[y][x] = rand() & 0xFF;
+        }
+    }
+
+    bool ok = check(&blit, lcd_blit_row_lut, "lut");
+#if LCD_BLIT_HAVE_SIMD
+    ok &= check(&blit, lcd_blit_row_simd, "simd");
+#endif
+    if (!ok)
+    {
+        return 1;
+    }
+
+    printf("32x16 frame at scale %d (%dx%d px)\n", scale, FRAME_WIDTH * scale, FRAME_HEIGHT * scale);
+    bench(&blit, lcd_blit_row_scalar, "scalar");
+    bench(&blit, lcd_blit_row_lut, "lut");
+#if LCD_BLIT_HAVE_SIMD
+#if defined(__SSE2__)
+    bench(&blit, lcd_blit_row_simd, "sse2");
+#else
+    bench(&blit, lcd_blit_row_simd, "neon");
+#endif
+#endif
+
+    double spi_us = FRAME_WIDTH * scale * FRAME_HEIGHT * scale * 16 / SPI_HZ * 1e6;
+    printf("spi      %8.1f us/frame at %.0f MHz\n", spi_us, SPI_HZ / 1e6);
+    return 0;
+}
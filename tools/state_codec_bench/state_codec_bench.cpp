@@ -0,0 +1,370 @@
+/*
+    Host benchmark for the compact save state encoding (src/state_codec.cpp).
+
+    Build and run from the repository root (only tamalib's headers are
+    needed, the state is backed by local buffers):
+        g++ -O2 -Iinclude -Ilib -Ilib/tamalib src/state_codec.cpp \
+            tools/state_codec_bench/state_codec_bench.cpp -o state_codec_bench
+        ./state_codec_bench [slot0.state ...]
+
+    With no arguments a few synthetic memory images are used; pass state
+    files copied from the SD card (old raw or new encoded) to measure real
+    saves. Every state is round-tripped and compared before it is timed,
+    and the CRC trailer has to reject every single-bit flip of the stream.
+*/
+
+#include "state_codec.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Size of a save in the raw layout written before the compact encoding
+#define RAW_STATE_SIZE (2 + 2 + 2 + 1 + 1 + 1 + 1 + 1 + 10 * 4 + 1 + 1 + 1 + 4 + \
+                        INT_SLOT_NUM * 4 + 1 + MEM_BUFFER_SIZE)
+
+typedef struct
+{
+    u13_t pc;
+    u12_t x, y;
+    u4_t a, b, flags;
+    u5_t np;
+    u8_t sp;
+    u32_t tick_counter;
+    u32_t timers[9];
+    bool_t prog_timer_enabled;
+    u8_t prog_timer_data, prog_timer_rld;
+    u32_t call_depth;
+    interrupt_t interrupts[INT_SLOT_NUM];
+    bool_t cpu_halted;
+    MEM_BUFFER_TYPE memory[MEM_BUFFER_SIZE];
+} storage_t;
+
+static state_t bind(storage_t *s)
+{
+    state_t state;
+    state.pc = &s->pc;
+    state.x = &s->x;
+    state.y = &s->y;
+    state.a = &s->a;
+    state.b = &s->b;
+    state.np = &s->np;
+    state.sp = &s->sp;
+    state.flags = &s->flags;
+    state.tick_counter = &s->tick_counter;
+    state.clk_timer_2hz_timestamp = &s->timers[0];
+    state.clk_timer_4hz_timestamp = &s->timers[1];
+    state.clk_timer_8hz_timestamp = &s->timers[2];
+    state.clk_timer_16hz_timestamp = &s->timers[3];
+    state.clk_timer_32hz_timestamp = &s->timers[4];
+    state.clk_timer_64hz_timestamp = &s->timers[5];
+    state.clk_timer_128hz_timestamp = &s->timers[6];
+    state.clk_timer_256hz_timestamp = &s->timers[7];
+    state.prog_timer_timestamp = &s->timers[8];
+    state.prog_timer_enabled = &s->prog_timer_enabled;
+    state.prog_timer_data = &s->prog_timer_data;
+    state.prog_timer_rld = &s->prog_timer_rld;
+    state.call_depth = &s->call_depth;
+    state.interrupts = s->interrupts;
+    state.cpu_halted = &s->cpu_halted;
+    state.memory = s->memory;
+    return state;
+}
+
+static size_t vector_write(void *ctx, const uint8_t *data, size_t len)
+{
+    std::vector<uint8_t> *out = (std::vector<uint8_t> *)ctx;
+    out->insert(out->end(), data, data + len);
+    return len;
+}
+
+typedef struct
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+} reader_t;
+
+static size_t buffer_read(void *ctx, uint8_t *data, size_t len)
+{
+    reader_t *r = (reader_t *)ctx;
+    size_t n = (size_t)(r->end - r->pos) < len ? r->end - r->pos : len;
+    memcpy(data, r->pos, n);
+    r->pos += n;
+    return n;
+}
+
+static bool same_state(const storage_t *a, const storage_t *b)
+{
+    bool same = a->pc == b->pc && a->x == b->x && a->y == b->y &&
+                a->a == b->a && a->b == b->b && a->flags == b->flags &&
+                a->np == b->np && a->sp == b->sp &&
+                a->tick_counter == b->tick_counter &&
+                !memcmp(a->timers, b->timers, sizeof(a->timers)) &&
+                a->prog_timer_enabled == b->prog_timer_enabled &&
+                a->prog_timer_data == b->prog_timer_data &&
+                a->prog_timer_rld == b->prog_timer_rld &&
+                a->call_depth == b->call_depth &&
+                a->cpu_halted == b->cpu_halted &&
+                !memcmp(a->memory, b->memory, sizeof(a->memory));
+    for (int i = 0; same && i < INT_SLOT_NUM; i++)
+    {
+        same = a->interrupts[i].factor_flag_reg == b->interrupts[i].factor_flag_reg &&
+               a->interrupts[i].mask_reg == b->interrupts[i].mask_reg &&
+               a->interrupts[i].triggered == b->interrupts[i].triggered &&
+               a->interrupts[i].vector == b->interrupts[i].vector;
+    }
+    return same;
+}
+
+// Bitwise CRC-32, independent of the codec's table
+static uint32_t crc32_ref(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+        }
+    }
+    return ~crc;
+}
+
+// The trailer has to match an independent CRC, and flipping any single bit
+// of the stream has to make state_check() fail
+static bool check_integrity(const char *name, std::vector<uint8_t> encoded)
+{
+    size_t body = encoded.size() - 4;
+    uint32_t trailer = encoded[body] | encoded[body + 1] << 8 |
+                       encoded[body + 2] << 16 | (uint32_t)encoded[body + 3] << 24;
+    if (trailer != crc32_ref(encoded.data(), body))
+    {
+        printf("%-20s CRC TRAILER MISMATCH\n", name);
+        return false;
+    }
+
+    size_t accepted = 0;
+    for (size_t bit = 0; bit < encoded.size() * 8; bit++)
+    {
+        encoded[bit / 8] ^= 1 << (bit % 8);
+        reader_t r = {encoded.data(), encoded.data() + encoded.size()};
+        accepted += state_check(buffer_read, &r);
+        encoded[bit / 8] ^= 1 << (bit % 8);
+    }
+    if (accepted)
+    {
+        printf("%-20s %zu of %zu bit flips accepted\n", name, accepted, encoded.size() * 8);
+        return false;
+    }
+    return true;
+}
+
+static bool run(const char *name, storage_t *src)
+{
+    const int iterations = 2000;
+    state_t state = bind(src);
+
+    std::vector<uint8_t> encoded;
+    if (!state_encode(&state, vector_write, &encoded))
+    {
+        printf("%-20s encode failed\n", name);
+        return false;
+    }
+
+    static storage_t dst;
+    memset(&dst, 0xAA, sizeof(dst));
+    state_t out = bind(&dst);
+    reader_t r = {encoded.data(), encoded.data() + encoded.size()};
+    if (!state_decode(&out, buffer_read, &r) || !same_state(src, &dst))
+    {
+        printf("%-20s ROUND TRIP MISMATCH\n", name);
+        return false;
+    }
+    if (!check_integrity(name, encoded))
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> sink;
+    sink.reserve(encoded.size());
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        sink.clear();
+        state_encode(&state, vector_write, &sink);
+    }
+    double encode_us = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e6 / iterations;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        reader_t r = {encoded.data(), encoded.data() + encoded.size()};
+        state_decode(&out, buffer_read, &r);
+    }
+    double decode_us = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e6 / iterations;
+
+    printf("%-20s %6d -> %5zu bytes  %5.1fx  encode %7.1f us  decode %7.1f us\n",
+           name, RAW_STATE_SIZE, encoded.size(), (double)RAW_STATE_SIZE / encoded.size(),
+           encode_us, decode_us);
+    return true;
+}
+
+static void fill_registers(storage_t *s)
+{
+    s->pc = 0x1234;
+    s->x = 0xE5A;
+    s->y = 0x07F;
+    s->a = 0x9;
+    s->b = 0x3;
+    s->flags = 0x5;
+    s->np = 0x12;
+    s->sp = 0xC8;
+    s->tick_counter = 123456789;
+    for (int i = 0; i < 9; i++)
+    {
+        s->timers[i] = s->tick_counter - (16384 >> i);
+    }
+    s->prog_timer_enabled = 1;
+    s->prog_timer_data = 0x40;
+    s->prog_timer_rld = 0x80;
+    s->call_depth = 3;
+    for (int i = 0; i < INT_SLOT_NUM; i++)
+    {
+        s->interrupts[i].factor_flag_reg = i;
+        s->interrupts[i].mask_reg = 0xF - i;
+        s->interrupts[i].triggered = i & 1;
+        s->interrupts[i].vector = 0x02 + i * 2;
+    }
+}
+
+static void set_nibble(storage_t *s, int addr, uint8_t v)
+{
+#ifdef LOW_FOOTPRINT
+    uint8_t *b = &s->memory[addr / 2];
+    *b = (addr & 1) ? (*b & 0x0F) | (v << 4) : (*b & 0xF0) | (v & 0xF);
+#else
+    s->memory[addr] = v & 0xF;
+#endif
+}
+
+// Sparse RAM use and a drawn display, roughly what a running game leaves
+static void fill_game_like(storage_t *s)
+{
+    memset(s->memory, 0, sizeof(s->memory));
+    for (int i = 0; i < MEM_RAM_SIZE; i++)
+    {
+        set_nibble(s, MEM_RAM_ADDR + i, (rand() % 3) ? 0 : rand() & 0xF);
+    }
+    for (int i = 0; i < MEM_DISPLAY1_SIZE; i++)
+    {
+        set_nibble(s, MEM_DISPLAY1_ADDR + i, (i % 10 < 4) ? 0xF : 0x0);
+        set_nibble(s, MEM_DISPLAY2_ADDR + i, (i % 7 < 2) ? 0x3 : 0x0);
+    }
+    for (int i = 0; i < MEM_IO_SIZE; i++)
+    {
+        set_nibble(s, MEM_IO_ADDR + i, rand() & 0xF);
+    }
+}
+
+static bool load_state_file(const char *path, storage_t *s)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    state_t state = bind(s);
+    if (state_is_encoded(data.data(), data.size()))
+    {
+        reader_t r = {data.data(), data.data() + data.size()};
+        return state_decode(&state, buffer_read, &r);
+    }
+    if (data.size() < RAW_STATE_SIZE)
+    {
+        return false;
+    }
+
+    // Raw layout, see apply_raw_state() in the firmware
+    const uint8_t *p = data.data();
+    auto field = [&](void *dst, size_t size)
+    {
+        memcpy(dst, p, size);
+        p += size;
+    };
+    field(state.pc, 2);
+    field(state.x, 2);
+    field(state.y, 2);
+    field(state.a, 1);
+    field(state.b, 1);
+    field(state.np, 1);
+    field(state.sp, 1);
+    field(state.flags, 1);
+    field(state.tick_counter, 4);
+    for (int i = 0; i < 9; i++)
+    {
+        field(&s->timers[i], 4);
+    }
+    field(state.prog_timer_enabled, 1);
+    field(state.prog_timer_data, 1);
+    field(state.prog_timer_rld, 1);
+    field(state.call_depth, 4);
+    for (int i = 0; i < INT_SLOT_NUM; i++)
+    {
+        field(&s->interrupts[i].factor_flag_reg, 1);
+        field(&s->interrupts[i].mask_reg, 1);
+        field(&s->interrupts[i].triggered, 1);
+        field(&s->interrupts[i].vector, 1);
+    }
+    field(state.cpu_halted, 1);
+    field(state.memory, MEM_BUFFER_SIZE);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static storage_t s;
+    bool ok = true;
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            memset(&s, 0, sizeof(s));
+            if (!load_state_file(argv[i], &s))
+            {
+                printf("%-20s not a state file\n", argv[i]);
+                ok = false;
+                continue;
+            }
+            ok &= run(argv[i], &s);
+        }
+        return ok ? 0 : 1;
+    }
+
+    srand(1);
+    fill_registers(&s);
+
+    memset(s.memory, 0, sizeof(s.memory));
+    ok &= run("empty memory", &s);
+
+    fill_game_like(&s);
+    ok &= run("game-like", &s);
+
+    for (int i = 0; i < MEM_BUFFER_SIZE; i++)
+    {
+        set_nibble(&s, i, rand() & 0xF);
+    }
+    ok &= run("random (worst case)", &s);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,729 @@
+/*
+    Headless input fuzzer and soak-test runner for the Tamagotchi ROM.
+
+    Runs tamalib with no display or sound at maximum speed, feeding random
+    or guided button sequences, and looks for runs that end in hal_halt(),
+    stall, corrupt the CPU state or diverge when replayed. Every failure is
+    written out as its input trace plus the state the run started from.
+
+    tamalib keeps its state in globals, so each worker is a separate
+    process (fork) and reports progress to the parent over a pipe.
+
+    Build from the repository root (needs the tamalib submodule):
+        cc -O2 -Ilib -c lib/tamalib/tamalib.c lib/tamalib/cpu.c lib/tamalib/hw.c
+        g++ -O2 -std=c++17 -Ilib -Ilib/tamalib -Iinclude tools/tama_fuzz/tama_fuzz.cpp \
+            src/state_codec.cpp tamalib.o cpu.o hw.o -o tama_fuzz
+
+    Usage:
+        ./tama_fuzz --rom tama.b [--state slot0.state] [--jobs N]
+                    [--minutes M] [--runs R] [--mode random|guided]
+                    [--verify N] [--seed S] [--out DIR]
+
+    Reproduce a failure:
+        ./tama_fuzz --rom tama.b --state fail_w0_r3.state --replay fail_w0_r3.trace
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include "tamalib.h"
+}
+#include "state_codec.h"
+
+#define ROM_SIZE 12288
+#define ROM_WORDS (ROM_SIZE / 2)
+#define TS_FREQ 1000000
+
+// A run is flagged as stalled when the LCD is not written for this long
+#define STALL_SECONDS 600
+// ... or when the PC does not move for this many steps while the CPU runs
+#define STALL_PC_STEPS 1000000
+// State hashes are recorded this often for replay verification
+#define CHECKPOINT_SECONDS 60
+
+typedef struct
+{
+    u32_t tick;
+    uint8_t button;
+    uint8_t pressed;
+} input_event_t;
+
+typedef struct
+{
+    const char *rom_path;
+    const char *state_path;
+    const char *out_dir;
+    const char *replay_path;
+    int jobs;
+    int runs;
+    uint32_t minutes;
+    bool guided;
+    int verify_every;
+    uint64_t seed;
+} options_t;
+
+// Progress record sent from a worker to the parent after every run
+typedef struct
+{
+    uint64_t ticks;
+    uint32_t failures;
+} progress_t;
+
+static options_t opts = {NULL, NULL, "fuzz_out", NULL, 0, 0, 60, false, 8, 0};
+static u12_t rom[ROM_WORDS];
+static std::vector<uint8_t> start_state;
+
+// Per-run flags set from the HAL callbacks
+static bool halted = false;
+static u32_t last_lcd_tick = 0;
+
+/*
+    Headless HAL
+*/
+
+static void *fuzz_malloc(u32_t size)
+{
+    return malloc(size);
+}
+
+static void fuzz_free(void *ptr)
+{
+    free(ptr);
+}
+
+static void fuzz_halt(void)
+{
+    halted = true;
+}
+
+static bool_t fuzz_is_log_enabled(log_level_t level)
+{
+    return 0;
+}
+
+static void fuzz_log(log_level_t level, char *buff, ...)
+{
+}
+
+static void fuzz_sleep_until(timestamp_t ts)
+{
+}
+
+// Emulated time, so screen refreshes follow the emulated clock
+static timestamp_t fuzz_get_timestamp(void)
+{
+    state_t *state = tamalib_get_state();
+    return (timestamp_t)((uint64_t)*state->tick_counter * TS_FREQ / TICK_FREQUENCY);
+}
+
+static void fuzz_update_screen(void)
+{
+}
+
+static void fuzz_set_lcd_matrix(u8_t x, u8_t y, bool_t val)
+{
+    last_lcd_tick = *tamalib_get_state()->tick_counter;
+}
+
+static void fuzz_set_lcd_icon(u8_t icon, bool_t val)
+{
+    last_lcd_tick = *tamalib_get_state()->tick_counter;
+}
+
+static void fuzz_set_frequency(u32_t freq)
+{
+}
+
+static void fuzz_play_frequency(bool_t en)
+{
+}
+
+static int fuzz_handler(void)
+{
+    return 0;
+}
+
+static hal_t hal = {
+    .malloc = fuzz_malloc,
+    .free = fuzz_free,
+    .halt = fuzz_halt,
+    .is_log_enabled = fuzz_is_log_enabled,
+    .log = fuzz_log,
+    .sleep_until = fuzz_sleep_until,
+    .get_timestamp = fuzz_get_timestamp,
+    .update_screen = fuzz_update_screen,
+    .set_lcd_matrix = fuzz_set_lcd_matrix,
+    .set_lcd_icon = fuzz_set_lcd_icon,
+    .set_frequency = fuzz_set_frequency,
+    .play_frequency = fuzz_play_frequency,
+    .handler = fuzz_handler,
+};
+
+/*
+    State snapshots, in the raw layout older firmware wrote. Files from
+    current firmware use the compact encoding (state_codec.h) and are
+    decoded on load.
+*/
+
+template <typename F>
+static void state_fields(state_t *state, F field)
+{
+    field(state->pc, sizeof(u13_t));
+    field(state->x, sizeof(u12_t));
+    field(state->y, sizeof(u12_t));
+    field(state->a, sizeof(u4_t));
+    field(state->b, sizeof(u4_t));
+    field(state->np, sizeof(u5_t));
+    field(state->sp, sizeof(u8_t));
+    field(state->flags, sizeof(u4_t));
+    field(state->tick_counter, sizeof(u32_t));
+    field(state->clk_timer_2hz_timestamp, sizeof(u32_t));
+    field(state->clk_timer_4hz_timestamp, sizeof(u32_t));
+    field(state->clk_timer_8hz_timestamp, sizeof(u32_t));
+    field(state->clk_timer_16hz_timestamp, sizeof(u32_t));
+    field(state->clk_timer_32hz_timestamp, sizeof(u32_t));
+    field(state->clk_timer_64hz_timestamp, sizeof(u32_t));
+    field(state->clk_timer_128hz_timestamp, sizeof(u32_t));
+    field(state->clk_timer_256hz_timestamp, sizeof(u32_t));
+    field(state->prog_timer_timestamp, sizeof(u32_t));
+    field(state->prog_timer_enabled, sizeof(bool_t));
+    field(state->prog_timer_data, sizeof(u8_t));
+    field(state->prog_timer_rld, sizeof(u8_t));
+    field(state->call_depth, sizeof(u32_t));
+    for (int i = 0; i < INT_SLOT_NUM; i++)
+    {
+        field(&state->interrupts[i].factor_flag_reg, sizeof(u4_t));
+        field(&state->interrupts[i].mask_reg, sizeof(u4_t));
+        field(&state->interrupts[i].triggered, sizeof(bool_t));
+        field(&state->interrupts[i].vector, sizeof(u8_t));
+    }
+    field(state->cpu_halted, sizeof(bool_t));
+    field(state->memory, MEM_BUFFER_SIZE);
+}
+
+static std::vector<uint8_t> state_save()
+{
+    std::vector<uint8_t> out;
+    state_fields(tamalib_get_state(), [&](void *p, size_t n)
+                 { out.insert(out.end(), (uint8_t *)p, (uint8_t *)p + n); });
+    return out;
+}
+
+static size_t state_vector_read(void *ctx, uint8_t *data, size_t len)
+{
+    auto *in = (std::pair<const std::vector<uint8_t> *, size_t> *)ctx;
+    size_t n = std::min(len, in->first->size() - in->second);
+    memcpy(data, in->first->data() + in->second, n);
+    in->second += n;
+    return n;
+}
+
+static bool state_load(const std::vector<uint8_t> &in)
+{
+    if (state_is_encoded(in.data(), in.size()))
+    {
+        std::pair<const std::vector<uint8_t> *, size_t> src(&in, 0);
+        if (!state_decode(tamalib_get_state(), state_vector_read, &src))
+        {
+            return false;
+        }
+        tamalib_refresh_hw();
+        return true;
+    }
+
+    size_t pos = 0;
+    bool ok = true;
+    state_fields(tamalib_get_state(), [&](void *p, size_t n)
+                 {
+                     if (pos + n > in.size())
+                     {
+                         ok = false;
+                         return;
+                     }
+                     memcpy(p, in.data() + pos, n);
+                     pos += n; });
+    if (ok)
+    {
+        tamalib_refresh_hw();
+    }
+    return ok;
+}
+
+// FNV-1a over the serialized state
+static uint64_t state_hash()
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint8_t b : state_save())
+    {
+        hash = (hash ^ b) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Invariants a healthy E0C6S46 state always satisfies
+static const char *state_corrupt()
+{
+    state_t *state = tamalib_get_state();
+    if (*state->pc >= 0x2000)
+        return "pc out of range";
+    if (*state->np >= 0x20)
+        return "np out of range";
+    if (*state->x >= 0x1000 || *state->y >= 0x1000)
+        return "index register out of range";
+    if (*state->a > 0xF || *state->b > 0xF || *state->flags > 0xF)
+        return "register holds more than a nibble";
+#ifndef LOW_FOOTPRINT
+    for (int i = 0; i < MEM_BUFFER_SIZE; i++)
+    {
+        if (state->memory[i] > 0xF)
+            return "memory cell holds more than a nibble";
+    }
+#endif
+    return NULL;
+}
+
+/*
+    Input generation
+*/
+
+static u32_t ms_to_ticks(uint32_t ms)
+{
+    return (u32_t)((uint64_t)ms * TICK_FREQUENCY / 1000);
+}
+
+static std::vector<input_event_t> make_trace(std::mt19937_64 &rng, u32_t start_tick, u32_t end_tick)
+{
+    std::vector<input_event_t> trace;
+    u32_t tick = start_tick;
+
+    while (true)
+    {
+        uint8_t button;
+        uint32_t hold_ms;
+        uint32_t gap_ms;
+
+        if (opts.guided)
+        {
+            // Menu-like play: mostly A to move and B to confirm, C to back
+            // out, with human press lengths and pauses
+            uint32_t r = rng() % 10;
+            button = r < 5 ? BTN_LEFT : (r < 8 ? BTN_MIDDLE : BTN_RIGHT);
+            hold_ms = 60 + rng() % 240;
+            gap_ms = 150 + rng() % (rng() % 8 ? 1500 : 120000);
+        }
+        else
+        {
+            button = rng() % 3;
+            hold_ms = 1 + rng() % 2000;
+            gap_ms = rng() % (rng() % 4 ? 500 : 600000);
+        }
+
+        tick += ms_to_ticks(gap_ms);
+        if (tick - start_tick >= end_tick - start_tick)
+        {
+            break;
+        }
+        trace.push_back({tick, button, 1});
+        tick += ms_to_ticks(hold_ms);
+        trace.push_back({tick, button, 0});
+    }
+    return trace;
+}
+
+/*
+    Runs
+*/
+
+typedef struct
+{
+    const char *failure;
+    uint64_t ticks;
+    std::vector<uint64_t> checkpoints;
+} run_result_t;
+
+static bool emulator_reset()
+{
+    static bool initialized = false;
+    if (initialized)
+    {
+        tamalib_release();
+    }
+    if (tamalib_init(rom, NULL, TS_FREQ))
+    {
+        return false;
+    }
+    initialized = true;
+    tamalib_set_speed(0);
+    tamalib_set_exec_mode(EXEC_MODE_RUN);
+    return start_state.empty() || state_load(start_state);
+}
+
+static run_result_t run_trace(const std::vector<input_event_t> &trace, u32_t end_tick)
+{
+    run_result_t result = {NULL, 0, {}};
+    state_t *state = tamalib_get_state();
+    u32_t start_tick = *state->tick_counter;
+    u32_t checkpoint_ticks = CHECKPOINT_SECONDS * TICK_FREQUENCY;
+    u32_t next_checkpoint = start_tick + checkpoint_ticks;
+    u13_t last_pc = *state->pc;
+    uint32_t pc_same_steps = 0;
+    size_t next_event = 0;
+
+    halted = false;
+    last_lcd_tick = start_tick;
+
+    while ((u32_t)(*state->tick_counter - start_tick) < end_tick - start_tick)
+    {
+        u32_t now = *state->tick_counter;
+        while (next_event < trace.size() && (u32_t)(now - trace[next_event].tick) < 0x80000000u)
+        {
+            tamalib_set_button((button_t)trace[next_event].button,
+                               trace[next_event].pressed ? BTN_STATE_PRESSED : BTN_STATE_RELEASED);
+            next_event++;
+        }
+
+        tamalib_step();
+
+        if (halted)
+        {
+            result.failure = "hal_halt";
+            break;
+        }
+
+        if (*state->pc == last_pc && !*state->cpu_halted)
+        {
+            if (++pc_same_steps >= STALL_PC_STEPS)
+            {
+                result.failure = "stall: pc stuck";
+                break;
+            }
+        }
+        else
+        {
+            last_pc = *state->pc;
+            pc_same_steps = 0;
+        }
+
+        if ((u32_t)(*state->tick_counter - last_lcd_tick) >= (u32_t)STALL_SECONDS * TICK_FREQUENCY)
+        {
+            result.failure = "stall: lcd not written";
+            break;
+        }
+
+        if ((u32_t)(*state->tick_counter - next_checkpoint) < 0x80000000u)
+        {
+            next_checkpoint += checkpoint_ticks;
+            result.checkpoints.push_back(state_hash());
+            result.failure = state_corrupt();
+            if (result.failure)
+            {
+                break;
+            }
+        }
+    }
+
+    result.ticks = (u32_t)(*state->tick_counter - start_tick);
+    return result;
+}
+
+static void save_failure(int worker, int run, const char *reason,
+                         const std::vector<uint8_t> &initial_state,
+                         const std::vector<input_event_t> &trace)
+{
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s/fail_w%d_r%d.state", opts.out_dir, worker, run);
+    FILE *f = fopen(path, "wb");
+    if (f)
+    {
+        fwrite(initial_state.data(), 1, initial_state.size(), f);
+        fclose(f);
+    }
+
+    snprintf(path, sizeof(path), "%s/fail_w%d_r%d.trace", opts.out_dir, worker, run);
+    f = fopen(path, "w");
+    if (f)
+    {
+        fprintf(f, "# %s\n# tick button pressed (ticks are %d Hz)\n", reason, TICK_FREQUENCY);
+        for (const input_event_t &ev : trace)
+        {
+            fprintf(f, "%u %u %u\n", ev.tick, ev.button, ev.pressed);
+        }
+        fclose(f);
+    }
+
+    fprintf(stderr, "[!] worker %d run %d: %s (saved to %s)\n", worker, run, reason, path);
+}
+
+static void worker_main(int worker, int fd)
+{
+    std::mt19937_64 rng(opts.seed + worker * 0x9E3779B97F4A7C15ULL);
+
+    for (int run = 0; opts.runs == 0 || run < opts.runs; run++)
+    {
+        progress_t progress = {0, 0};
+
+        if (!emulator_reset())
+        {
+            fprintf(stderr, "[!] worker %d: emulator init failed\n", worker);
+            _exit(1);
+        }
+
+        std::vector<uint8_t> initial_state = state_save();
+        u32_t start_tick = *tamalib_get_state()->tick_counter;
+        u32_t end_tick = start_tick + ms_to_ticks(opts.minutes * 60000);
+        std::vector<input_event_t> trace = make_trace(rng, start_tick, end_tick);
+
+        run_result_t result = run_trace(trace, end_tick);
+        progress.ticks = result.ticks;
+
+        // Replay every Nth clean run and compare checkpoint hashes
+        if (!result.failure && opts.verify_every && run % opts.verify_every == 0)
+        {
+            emulator_reset();
+            run_result_t replay = run_trace(trace, end_tick);
+            progress.ticks += replay.ticks;
+            if (replay.checkpoints != result.checkpoints)
+            {
+                result.failure = "state hash diverged on replay";
+            }
+        }
+
+        if (result.failure)
+        {
+            save_failure(worker, run, result.failure, initial_state, trace);
+            progress.failures = 1;
+        }
+
+        if (write(fd, &progress, sizeof(progress)) != sizeof(progress))
+        {
+            _exit(1);
+        }
+    }
+    _exit(0);
+}
+
+// Run a saved trace once from the loaded state and report the outcome
+static int replay_main()
+{
+    FILE *f = fopen(opts.replay_path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "[!] Cannot read %s\n", opts.replay_path);
+        return 1;
+    }
+
+    std::vector<input_event_t> trace;
+    char line[128];
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned tick, button, pressed;
+        if (line[0] != '#' && sscanf(line, "%u %u %u", &tick, &button, &pressed) == 3)
+        {
+            trace.push_back({tick, (uint8_t)button, (uint8_t)pressed});
+        }
+    }
+    fclose(f);
+
+    if (!emulator_reset())
+    {
+        fprintf(stderr, "[!] Emulator init failed\n");
+        return 1;
+    }
+    u32_t start_tick = *tamalib_get_state()->tick_counter;
+    run_result_t result = run_trace(trace, start_tick + ms_to_ticks(opts.minutes * 60000));
+    printf("[*] %zu events, %.1f emulated minutes: %s\n", trace.size(),
+           (double)result.ticks / TICK_FREQUENCY / 60.0, result.failure ? result.failure : "no failure");
+    return result.failure ? 3 : 0;
+}
+
+/*
+    Setup
+*/
+
+static bool load_file(const char *path, std::vector<uint8_t> &out)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        out.insert(out.end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool load_rom(const char *path)
+{
+    std::vector<uint8_t> raw;
+    if (!load_file(path, raw) || raw.size() != ROM_SIZE)
+    {
+        return false;
+    }
+    // Big-endian 16-bit words, same result as load_rom() on the device
+    for (int i = 0; i < ROM_WORDS; i++)
+    {
+        rom[i] = ((raw[i * 2] << 8) | raw[i * 2 + 1]) & 0xFFF;
+    }
+    return true;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s --rom FILE [--state FILE] [--jobs N] [--minutes M] [--runs R]\n"
+            "       [--mode random|guided] [--verify N] [--seed S] [--out DIR]\n"
+            "       %s --rom FILE [--state FILE] [--minutes M] --replay TRACE\n",
+            argv0, argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    opts.seed = (uint64_t)time(NULL);
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        const char *val = argv[++i];
+
+        if (arg == "--rom")
+            opts.rom_path = val;
+        else if (arg == "--state")
+            opts.state_path = val;
+        else if (arg == "--out")
+            opts.out_dir = val;
+        else if (arg == "--jobs")
+            opts.jobs = atoi(val);
+        else if (arg == "--runs")
+            opts.runs = atoi(val);
+        else if (arg == "--minutes")
+            opts.minutes = strtoul(val, NULL, 10);
+        else if (arg == "--mode")
+            opts.guided = !strcmp(val, "guided");
+        else if (arg == "--verify")
+            opts.verify_every = atoi(val);
+        else if (arg == "--seed")
+            opts.seed = strtoull(val, NULL, 10);
+        else if (arg == "--replay")
+            opts.replay_path = val;
+        else
+            usage(argv[0]);
+    }
+
+    if (!opts.rom_path || !load_rom(opts.rom_path))
+    {
+        fprintf(stderr, "[!] ROM missing or not %d bytes\n", ROM_SIZE);
+        return 1;
+    }
+    if (opts.state_path && !load_file(opts.state_path, start_state))
+    {
+        fprintf(stderr, "[!] Cannot read %s\n", opts.state_path);
+        return 1;
+    }
+    if (opts.jobs <= 0)
+    {
+        opts.jobs = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    }
+    // Emulated minutes must fit the 32-bit tick counter
+    if (opts.minutes == 0 || opts.minutes > 2000)
+    {
+        fprintf(stderr, "[!] --minutes must be 1..2000\n");
+        return 1;
+    }
+    tamalib_register_hal(&hal);
+    if (opts.replay_path)
+    {
+        return replay_main();
+    }
+    mkdir(opts.out_dir, 0755);
+
+    printf("[*] %d workers, %u emulated minutes per run, %s inputs, seed %llu\n",
+           opts.jobs, opts.minutes, opts.guided ? "guided" : "random", (unsigned long long)opts.seed);
+
+    fflush(stdout);
+    int pipefd[2];
+    if (pipe(pipefd))
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    std::vector<pid_t> workers;
+    for (int w = 0; w < opts.jobs; w++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(pipefd[0]);
+            worker_main(w, pipefd[1]);
+        }
+        workers.push_back(pid);
+    }
+    close(pipefd[1]);
+
+    // Aggregate progress until every worker has exited
+    auto start = std::chrono::steady_clock::now();
+    auto last_report = start;
+    uint64_t total_ticks = 0;
+    uint32_t total_runs = 0;
+    uint32_t total_failures = 0;
+    progress_t progress;
+    ssize_t n;
+
+    auto report = [&]()
+    {
+        double wall_min = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 60.0;
+        double emu_hours = (double)total_ticks / TICK_FREQUENCY / 3600.0;
+        printf("[*] %u runs, %u failures, %.1f emulated hours in %.2f min: %.1f emulated h / wall min\n",
+               total_runs, total_failures, emu_hours, wall_min, wall_min > 0 ? emu_hours / wall_min : 0.0);
+        fflush(stdout);
+    };
+
+    while ((n = read(pipefd[0], &progress, sizeof(progress))) == sizeof(progress) ||
+           (n < 0 && errno == EINTR))
+    {
+        if (n < 0)
+            continue;
+        total_ticks += progress.ticks;
+        total_failures += progress.failures;
+        total_runs++;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_report >= std::chrono::seconds(5))
+        {
+            last_report = now;
+            report();
+        }
+    }
+
+    for (pid_t pid : workers)
+    {
+        waitpid(pid, NULL, 0);
+    }
+    report();
+    return total_failures ? 3 : 0;
+}
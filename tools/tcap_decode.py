@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Decode a Tamaputer frame capture into a PNG sequence or an animated GIF.
+
+The input is either a recording from the SD card (/tamaputer/capture.tcap)
+or a raw dump of the USB serial port taken while streaming, e.g.:
+
+    cat /dev/ttyACM0 > capture.bin      # press C on the Cardputer to start/stop
+    python3 tools/tcap_decode.py capture.bin --png frames/
+    python3 tools/tcap_decode.py capture.tcap --gif capture.gif
+
+Serial dumps may have log lines mixed in; packets are found by their
+'TF' sync bytes and checked with their checksum. PNG output only needs the
+standard library; GIF output needs Pillow.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+WIDTH = 32
+HEIGHT = 16
+ICON_COUNT = 8
+MATRIX_SIZE = WIDTH * HEIGHT // 8
+FRAME_SIZE = MATRIX_SIZE + 1
+FLAG_KEYFRAME = 0x01
+
+
+def rle_decode(data):
+    """PackBits decode, None if the data is malformed."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        c = data[i]
+        i += 1
+        if c < 0x80:
+            if i + c + 1 > len(data):
+                return None
+            out += data[i:i + c + 1]
+            i += c + 1
+        else:
+            if i >= len(data):
+                return None
+            out += bytes([data[i]]) * ((c & 0x7F) + 2)
+            i += 1
+    return bytes(out)
+
+
+def packets(data):
+    """Yield (flags, seq, time_ms, delta) for every valid packet."""
+    i = 0
+    while True:
+        i = data.find(b"TF", i)
+        if i < 0 or i + 11 > len(data):
+            return
+        flags, seq, time_ms, length = struct.unpack_from("<BHIB", data, i + 2)
+        end = i + 10 + length
+        delta = None
+        if end < len(data) and (sum(data[i + 2:end]) & 0xFF) == data[end]:
+            delta = rle_decode(data[i + 10:end])
+        if delta is None or len(delta) != FRAME_SIZE:
+            i += 1
+            continue
+        yield flags, seq, time_ms, delta
+        i = end + 1
+
+
+def frames(data):
+    """Yield (time_ms, frame bytes) after reapplying the XOR deltas."""
+    frame = None
+    expected_seq = None
+    for flags, seq, time_ms, delta in packets(data):
+        if flags & FLAG_KEYFRAME:
+            frame = bytearray(FRAME_SIZE)
+        elif frame is None or seq != expected_seq:
+            # Lost a packet, wait for the next keyframe
+            frame = None
+            expected_seq = None
+            continue
+        for j in range(FRAME_SIZE):
+            frame[j] ^= delta[j]
+        expected_seq = (seq + 1) & 0xFFFF
+        yield time_ms, bytes(frame)
+
+
+def render(frame, scale):
+    """Return rows of grayscale pixels: the LCD plus a row of icon markers."""
+    icon_rows = 3
+    rows = []
+    for y in range(HEIGHT):
+        row = []
+        for x in range(WIDTH):
+            on = frame[y * (WIDTH // 8) + x // 8] & (0x80 >> (x % 8))
+            row += [0 if on else 255] * scale
+        rows += [row] * scale
+    # One 3x3 block per icon, evenly spaced under the LCD
+    icons = frame[MATRIX_SIZE]
+    blank = [255] * (WIDTH * scale)
+    rows += [blank] * scale
+    for _ in range(icon_rows * scale):
+        row = list(blank)
+        for i in range(ICON_COUNT):
+            if icons & (1 << i):
+                x0 = (i * 4 + 1) * scale
+                row[x0:x0 + icon_rows * scale] = [0] * (icon_rows * scale)
+        rows.append(row)
+    return rows
+
+
+def write_png(path, rows):
+    def chunk(kind, body):
+        return (struct.pack(">I", len(body)) + kind + body +
+                struct.pack(">I", zlib.crc32(kind + body) & 0xFFFFFFFF))
+
+    raw = b"".join(b"\x00" + bytes(row) for row in rows)
+    with open(path, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(chunk(b"IHDR", struct.pack(">IIBBBBB", len(rows[0]), len(rows), 8, 0, 0, 0, 0)))
+        f.write(chunk(b"IDAT", zlib.compress(raw)))
+        f.write(chunk(b"IEND", b""))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("input", help="capture file or serial dump")
+    parser.add_argument("--png", metavar="DIR", help="write frame_NNNNN.png files to DIR")
+    parser.add_argument("--gif", metavar="FILE", help="write an animated GIF (needs Pillow)")
+    parser.add_argument("--scale", type=int, default=4, help="pixel scale (default 4)")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+    if data[:4] == b"TCAP":
+        data = data[8:]
+
+    decoded = list(frames(data))
+    print("%d frames decoded" % len(decoded))
+    if not decoded:
+        return 1
+
+    if args.png:
+        os.makedirs(args.png, exist_ok=True)
+        for n, (_, frame) in enumerate(decoded):
+            write_png(os.path.join(args.png, "frame_%05d.png" % n), render(frame, args.scale))
+
+    if args.gif:
+        try:
+            from PIL import Image
+        except ImportError:
+            print("GIF output needs Pillow (pip install pillow)", file=sys.stderr)
+            return 1
+        images = []
+        for _, frame in decoded:
+            rows = render(frame, args.scale)
+            img = Image.new("L", (len(rows[0]), len(rows)))
+            img.putdata([p for row in rows for p in row])
+            images.append(img.convert("P"))
+        durations = [max(b[0] - a[0], 20) for a, b in zip(decoded, decoded[1:])] + [100]
+        images[0].save(args.gif, save_all=True, append_images=images[1:],
+                       duration=durations, loop=0)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
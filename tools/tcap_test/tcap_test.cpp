@@ -0,0 +1,164 @@
+/*
+    Host test for the frame capture packet encoder (src/capture_packet.cpp).
+
+    Build and run from the repository root:
+        g++ -O2 -Iinclude src/capture_packet.cpp tools/tcap_test/tcap_test.cpp -o tcap_test
+        ./tcap_test [out.tcap]
+
+    Worst-case and random frames are encoded, checked against
+    CAPTURE_PACKET_MAX and decoded back. They are then written as a
+    recording (default /tmp/tcap_test.tcap) and passed through
+    tools/tcap_decode.py, which has to decode every frame.
+*/
+
+#include "capture_packet.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Guard bytes after the packet catch writes past CAPTURE_PACKET_MAX
+#define GUARD_SIZE 64
+#define GUARD_BYTE 0xA5
+
+static bool rle_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_len)
+{
+    size_t out = 0;
+    size_t i = 0;
+    while (i < len)
+    {
+        uint8_t c = src[i++];
+        size_t n = c < 0x80 ? c + 1 : (c & 0x7F) + 2;
+        if (out + n > dst_len || i + (c < 0x80 ? n : 1) > len)
+        {
+            return false;
+        }
+        if (c < 0x80)
+        {
+            memcpy(dst + out, src + i, n);
+            i += n;
+        }
+        else
+        {
+            memset(dst + out, src[i++], n);
+        }
+        out += n;
+    }
+    return out == dst_len;
+}
+
+// "a bb c dd ...", the pattern that grew the old encoder's output most
+static void pattern_pairs(uint8_t *frame, int phase)
+{
+    uint8_t value = 1;
+    for (int i = 0; i < CAPTURE_FRAME_SIZE; value++)
+    {
+        int count = (value + phase) % 2 ? 1 : 2;
+        for (int n = 0; n < count && i < CAPTURE_FRAME_SIZE; n++)
+        {
+            frame[i++] = value;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "/tmp/tcap_test.tcap";
+
+    std::vector<std::vector<uint8_t>> frames;
+    uint8_t frame[CAPTURE_FRAME_SIZE];
+
+    for (int phase = 0; phase < 2; phase++)
+    {
+        pattern_pairs(frame, phase);
+        frames.emplace_back(frame, frame + CAPTURE_FRAME_SIZE);
+    }
+    for (int i = 0; i < CAPTURE_FRAME_SIZE; i++)
+    {
+        frame[i] = i; // No runs at all
+    }
+    frames.emplace_back(frame, frame + CAPTURE_FRAME_SIZE);
+    memset(frame, 0, sizeof(frame)); // One long run
+    frames.emplace_back(frame, frame + CAPTURE_FRAME_SIZE);
+
+    srand(1);
+    for (int n = 0; n < 20000; n++)
+    {
+        // Few distinct values so runs of every length show up
+        int values = 1 + n % 4;
+        for (int i = 0; i < CAPTURE_FRAME_SIZE; i++)
+        {
+            frame[i] = rand() % values;
+        }
+        frames.emplace_back(frame, frame + CAPTURE_FRAME_SIZE);
+    }
+
+    FILE *out = fopen(path, "wb");
+    if (!out)
+    {
+        fprintf(stderr, "Can't write %s\n", path);
+        return 1;
+    }
+    const uint8_t header[8] = {'T', 'C', 'A', 'P', 1, 32, 16, 8};
+    fwrite(header, 1, sizeof(header), out);
+
+    int failures = 0;
+    size_t largest = 0;
+    for (size_t n = 0; n < frames.size(); n++)
+    {
+        uint8_t packet[CAPTURE_PACKET_MAX + GUARD_SIZE];
+        memset(packet, GUARD_BYTE, sizeof(packet));
+
+        // Every frame is a keyframe, so each one decodes on its own
+        uint8_t len = capture_packet(packet, CAPTURE_FLAG_KEYFRAME, n, n * 100, frames[n].data());
+        largest = len > largest ? len : largest;
+
+        bool guard_ok = true;
+        for (int i = CAPTURE_PACKET_MAX; i < (int)sizeof(packet); i++)
+        {
+            guard_ok &= packet[i] == GUARD_BYTE;
+        }
+
+        uint8_t decoded[CAPTURE_FRAME_SIZE];
+        if (len > CAPTURE_PACKET_MAX || !guard_ok ||
+            !rle_decode(packet + 10, packet[9], decoded, sizeof(decoded)) ||
+            memcmp(decoded, frames[n].data(), CAPTURE_FRAME_SIZE) != 0)
+        {
+            if (failures++ < 5)
+            {
+                fprintf(stderr, "FAIL frame %zu: packet %u bytes (max %d)\n",
+                        n, len, CAPTURE_PACKET_MAX);
+            }
+            continue;
+        }
+        fwrite(packet, 1, len, out);
+    }
+    fclose(out);
+
+    printf("%zu frames encoded, largest packet %zu bytes (max %d), %d failures\n",
+           frames.size(), largest, CAPTURE_PACKET_MAX, failures);
+    if (failures)
+    {
+        return 1;
+    }
+
+    // The decoder has to accept every packet
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "python3 tools/tcap_decode.py %s", path);
+    FILE *decoder = popen(cmd, "r");
+    if (!decoder)
+    {
+        fprintf(stderr, "Running tcap_decode.py failed\n");
+        return 1;
+    }
+    unsigned decoded_frames = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), decoder))
+    {
+        sscanf(line, "%u frames decoded", &decoded_frames);
+    }
+    pclose(decoder);
+
+    printf("tcap_decode.py: %u of %zu frames decoded\n", decoded_frames, frames.size());
+    return decoded_frames == frames.size() ? 0 : 1;
+}